@@ -0,0 +1,449 @@
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "physics.h"
+
+// Results that outlive the process, for captures that get asked about
+// again without having changed.
+//
+// Entries are keyed by a hash of the capture's bytes plus everything
+// else a result depends on (phy_fingerprint()), one small file per
+// capture and run in the cache directory. Hashing is a straight read(2)
+// through the file, so a hit costs one pass over the bytes, but no
+// parsing of them.
+//
+// Readers don't lock: entries only ever show up by rename(2), so an
+// open gets the old one or the new one and never half of either.
+// Writers take an flock(2) on the lock file, which also keeps a
+// running total of what's on disk. When that goes over budget, the
+// least recently used entries (by mtime, which a hit bumps) go until
+// it's back under CACHE_LOW_WATER of it.
+//
+// None of this is allowed to fail an analysis. Trouble is a warning
+// and a miss, and after one warning the cache is off for the process.
+
+#define CACHE_MAGIC 0x62666331	// "bfc1"
+#define CACHE_LOCK ".lock"
+#define CACHE_CHUNK (64 * 1024)
+#define CACHE_LOW_WATER 0.9
+#define MAX_CACHE_FILES 16384
+
+// Key, in hex, then "." and the run
+#define KEY_HEX 32
+#define ENTRY_NAME (KEY_HEX + 16)
+
+struct cache_entry {
+	uint32_t magic;
+	uint32_t valid;		// bit per METRIC_*
+	uint64_t key[2];
+	int32_t run;
+	int32_t reserved;
+	struct result r[NUM_METRICS];
+};
+
+// What the lock file holds
+struct cache_usage {
+	uint32_t magic;
+	uint32_t reserved;
+	uint64_t bytes;		// allocated on disk, entries only
+};
+
+struct victim {
+	time_t mtime;
+	uint64_t bytes;
+	char name[ENTRY_NAME];
+};
+
+static char dir[PATH_MAX] = { 0 };
+static int dfd = -1;
+static uint64_t budget = 0;
+
+static int bound = 0;
+static uint64_t key[2] = { 0 };
+
+// The entry for the run we're on, as of the last look at it
+static struct cache_entry cur = { 0 };
+
+static unsigned char chunk[CACHE_CHUNK] = { 0 };
+static struct victim victims[MAX_CACHE_FILES] = { 0 };
+
+// MARK: Hashing
+
+// Two lanes of multiply-rotate over 8-byte words, finished off with
+// murmur3's fmix64. Fast, and plenty for telling files apart; not
+// meant to stand up to anybody trying to collide it.
+#define HASH_K0 0x9e3779b97f4a7c15ULL
+#define HASH_K1 0xc2b2ae3d27d4eb4fULL
+#define HASH_K2 0x165667b19e3779f9ULL
+
+struct hasher {
+	uint64_t a;
+	uint64_t b;
+	uint64_t len;
+};
+
+static uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t fmix64(uint64_t k) {
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+static void hash_word(struct hasher *h, uint64_t w) {
+	h->a = rotl(h->a ^ w * HASH_K0, 31) * HASH_K1;
+	h->b = rotl(h->b ^ w * HASH_K2, 27) * HASH_K0;
+}
+
+// Anything but the last call takes whole words
+static void hash_update(struct hasher *h, const unsigned char *p, size_t n) {
+	uint64_t w = 0;
+	size_t i = 0;
+
+	assert(h->len % 8 == 0);
+
+	for (; i + 8 <= n; i += 8) {
+		memcpy(&w, p + i, 8);
+		hash_word(h, w);
+	}
+
+	if (i < n) {
+		w = 0;
+		memcpy(&w, p + i, n - i);
+		hash_word(h, w);
+	}
+
+	h->len += n;
+}
+
+static void hash_final(struct hasher *h, uint64_t out[2]) {
+	uint64_t a = h->a ^ h->len, b = h->b ^ rotl(h->len, 32);
+
+	a += b;
+	b += a;
+	a = fmix64(a);
+	b = fmix64(b);
+	out[0] = a + b;
+	out[1] = b + out[0];
+}
+
+// Whole chunks, short only at EOF
+static ssize_t read_chunk(int fd) {
+	size_t got = 0;
+
+	while (got < sizeof(chunk)) {
+		ssize_t r = read(fd, chunk + got, sizeof(chunk) - got);
+
+		if (r < 0 && errno == EINTR) {
+			continue;
+		} else if (r < 0) {
+			return -1;
+		} else if (r == 0) {
+			break;
+		}
+
+		got += (size_t)r;
+	}
+
+	return (ssize_t)got;
+}
+
+// MARK: Entries
+
+static void trouble(const char *what) {
+	warn("cache %s", what);
+	bound = 0;
+}
+
+static void entry_name(char *name, int run) {
+	snprintf(name, ENTRY_NAME, "%016llx%016llx.%d", (unsigned long long)key[0], (unsigned long long)key[1], run);
+}
+
+static uint64_t allocated(const struct stat *sb) {
+	return (uint64_t)sb->st_blocks * 512;
+}
+
+// What's on disk for run, or an empty entry if nothing (usable) is
+static void load(int run, int touch) {
+	char name[ENTRY_NAME] = { 0 };
+	struct cache_entry e = { 0 };
+	ssize_t r = 0;
+	int fd = -1;
+
+	bzero(&cur, sizeof(cur));
+	cur.magic = CACHE_MAGIC;
+	cur.key[0] = key[0];
+	cur.key[1] = key[1];
+	cur.run = run;
+
+	entry_name(name, run);
+	if ((fd = openat(dfd, name, O_RDONLY)) < 0) {
+		if (errno != ENOENT) {
+			trouble(name);
+		}
+		return;
+	}
+
+	// A torn or foreign entry is just a miss
+	while ((r = read(fd, &e, sizeof(e))) < 0 && errno == EINTR) {
+		continue;
+	}
+
+	if (r == sizeof(e) && e.magic == CACHE_MAGIC && e.run == run && e.key[0] == key[0] && e.key[1] == key[1]) {
+		cur.valid = e.valid & ((1u << NUM_METRICS) - 1);
+		memcpy(cur.r, e.r, sizeof(cur.r));
+
+		if (touch != 0) {
+			futimens(fd, NULL);
+		}
+	}
+
+	close(fd);
+}
+
+// MARK: Eviction
+
+// Whole seconds: st_mtim isn't spelled the same everywhere, and
+// nobody's going to miss the difference
+static int by_mtime(const void *a, const void *b) {
+	const struct victim *va = a, *vb = b;
+
+	return (va->mtime > vb->mtime) - (va->mtime < vb->mtime);
+}
+
+// Under the lock. Counts what's really there, and if that's over
+// budget, drops the oldest. Returns what's left.
+static uint64_t evict(void) {
+	struct dirent *de = NULL;
+	uint64_t total = 0;
+	DIR *d = NULL;
+	int n = 0;
+
+	if (NULL == (d = opendir(dir))) {
+		trouble(dir);
+		return 0;
+	}
+
+	// 1. Take stock
+	while (NULL != (de = readdir(d))) {
+		struct stat sb = { 0 };
+
+		if (fstatat(dfd, de->d_name, &sb, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(sb.st_mode)) {
+			continue;
+		} else if (de->d_name[0] == '.') {
+			// Temporaries only exist under the lock, which is ours,
+			// so these belong to a writer that died
+			if (strcmp(de->d_name, CACHE_LOCK) != 0) {
+				unlinkat(dfd, de->d_name, 0);
+			}
+			continue;
+		}
+
+		total += allocated(&sb);
+		if (n < MAX_CACHE_FILES && strlen(de->d_name) < ENTRY_NAME) {
+			victims[n].mtime = sb.st_mtime;
+			victims[n].bytes = allocated(&sb);
+			memcpy(victims[n].name, de->d_name, strlen(de->d_name) + 1);
+			n++;
+		}
+	}
+
+	closedir(d);
+
+	if (total <= budget) {
+		return total;
+	}
+
+	// 2. Oldest first, down past the budget so the next few puts
+	// don't land right back here
+	qsort(victims, (size_t)n, sizeof(victims[0]), by_mtime);
+
+	for (int i = 0; i < n && (double)total > CACHE_LOW_WATER * (double)budget; i++) {
+		if (unlinkat(dfd, victims[i].name, 0) == 0) {
+			total -= victims[i].bytes;
+		}
+	}
+
+	return total;
+}
+
+// MARK: API
+
+void cache_open(const char *path, size_t bytes) {
+	assert(path != NULL && bytes > 0);
+
+	if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+		err(1, "cache %s", path);
+	} else if (strlen(path) >= sizeof(dir)) {
+		errx(1, "cache %s: path too long", path);
+	} else if ((dfd = open(path, O_RDONLY | O_DIRECTORY)) < 0) {
+		err(1, "cache %s", path);
+	}
+
+	snprintf(dir, sizeof(dir), "%s", path);
+	budget = bytes;
+}
+
+// Looks at path's bytes, so it's on to the file as it is right now
+int cache_bind(const char *path) {
+	char fp[BUFSIZ] = { 0 };
+	struct hasher h = { .a = HASH_K1, .b = HASH_K2 };
+	uint64_t digest[2] = { 0 };
+	ssize_t r = 0;
+	int fd = -1, l = 0;
+
+	assert(path != NULL);
+
+	bound = 0;
+	bzero(&cur, sizeof(cur));
+
+	if (dfd < 0) {
+		return -1;
+	} else if ((fd = open(path, O_RDONLY)) < 0) {
+		// bf_open() will have something to say about this
+		return -1;
+	}
+
+	// 1. The capture
+	while ((r = read_chunk(fd)) > 0) {
+		hash_update(&h, chunk, (size_t)r);
+		if ((size_t)r < sizeof(chunk)) {
+			break;
+		}
+	}
+
+	close(fd);
+	if (r < 0) {
+		warn("cache %s", path);
+		return -1;
+	}
+
+	hash_final(&h, digest);
+
+	// 2. Everything else that goes into a result
+	l = phy_fingerprint(fp, sizeof(fp));
+	assert(l > 0 && (size_t)l < sizeof(fp));
+
+	h = (struct hasher){ .a = HASH_K1, .b = HASH_K2 };
+	hash_update(&h, (const unsigned char *)digest, sizeof(digest));
+	hash_update(&h, (const unsigned char *)fp, (size_t)l);
+	hash_final(&h, key);
+
+	bound = 1;
+	return 0;
+}
+
+int cache_get(int run, int metric, struct result *out) {
+	assert(metric >= 0 && metric < NUM_METRICS);
+	assert(out != NULL);
+
+	if (bound == 0) {
+		return -1;
+	} else if (cur.run != run) {
+		load(run, 1);
+	}
+
+	if ((cur.valid & (1u << metric)) == 0) {
+		return -1;
+	}
+
+	*out = cur.r[metric];
+	return 0;
+}
+
+// Under the lock: cur, swapped in for whatever's there now
+static void store(int lfd) {
+	char name[ENTRY_NAME] = { 0 }, tmp[ENTRY_NAME + 32] = { 0 };
+	struct cache_usage u = { 0 };
+	struct stat old = { 0 }, sb = { 0 };
+	int fd = -1;
+
+	// 1. Write it off to the side
+	entry_name(name, cur.run);
+	snprintf(tmp, sizeof(tmp), ".%s.%ld", name, (long)getpid());
+
+	if ((fd = openat(dfd, tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0) {
+		trouble(tmp);
+		return;
+	} else if (write(fd, &cur, sizeof(cur)) != sizeof(cur) || fstat(fd, &sb) != 0) {
+		trouble(tmp);
+		close(fd);
+		unlinkat(dfd, tmp, 0);
+		return;
+	}
+
+	close(fd);
+
+	// 2. Swap it in
+	if (fstatat(dfd, name, &old, 0) != 0) {
+		bzero(&old, sizeof(old));
+	}
+
+	if (renameat(dfd, tmp, dfd, name) != 0) {
+		trouble(name);
+		unlinkat(dfd, tmp, 0);
+		return;
+	}
+
+	// 3. Keep count, and once over budget, count properly and trim
+	if (pread(lfd, &u, sizeof(u), 0) != sizeof(u) || u.magic != CACHE_MAGIC) {
+		u = (struct cache_usage){ .magic = CACHE_MAGIC, .bytes = UINT64_MAX };
+	} else {
+		u.bytes += allocated(&sb);
+		u.bytes -= u.bytes >= allocated(&old) ? allocated(&old) : u.bytes;
+	}
+
+	if (u.bytes > budget) {
+		u.bytes = evict();
+	}
+
+	if (pwrite(lfd, &u, sizeof(u), 0) != sizeof(u)) {
+		trouble(CACHE_LOCK);
+	}
+}
+
+void cache_put(int run, int metric, struct result r) {
+	int lfd = -1;
+
+	assert(metric >= 0 && metric < NUM_METRICS);
+
+	if (bound == 0) {
+		return;
+	}
+
+	// Opened every time: a descriptor inherited across fork(2) would
+	// have catalog workers all sharing the one lock
+	if ((lfd = openat(dfd, CACHE_LOCK, O_RDWR | O_CREAT, 0666)) < 0) {
+		trouble(CACHE_LOCK);
+		return;
+	} else if (flock(lfd, LOCK_EX) != 0) {
+		trouble(CACHE_LOCK);
+		close(lfd);
+		return;
+	}
+
+	// Somebody else may have filled in other metrics since we looked
+	load(run, 0);
+	if (bound != 0) {
+		cur.valid |= 1u << metric;
+		cur.r[metric] = r;
+		store(lfd);
+	}
+
+	// Closing drops the lock
+	close(lfd);
+}
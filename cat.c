@@ -0,0 +1,476 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "physics.h"
+
+// Season-wide statistics over a catalog of captures.
+//
+// The catalog is a manifest with one capture per line:
+//
+//	# athlete  file            runs
+//	alice      2025-11-30.csv  j3 f9 f10
+//
+// where jN/fN are jump and flip runs, and relative paths are relative
+// to the manifest. Pointed at a directory, we read the manifest named
+// "catalog" inside it. Lines for the same athlete are taken to be in
+// chronological order, which is what the trend is against.
+//
+// Each capture is analyzed by a worker process of its own, at most
+// nworkers at a time, so only that many files are ever loaded. Workers
+// send back moments for just their capture, which get merged into the
+// athlete's running totals. A capture that won't open is skipped, and
+// so is any run in it that bf_metric() can't make sense of, with the
+// reason why; the rest of the capture still counts.
+
+#define MAX_CAPTURES 1024
+#define MAX_ATHLETES 64
+#define MAX_CAPTURE_RUNS 16
+#define MAX_POOL 64
+#define ATHLETE_NAME 64
+#define CATALOG_FILE "catalog"
+
+#define KIND_JUMP 0
+#define KIND_FLIP 1
+#define NUM_KINDS 2
+
+struct capture {
+	int athlete;
+	int seq;		// athlete's nth capture
+	char path[PATH_MAX];
+
+	int nruns;
+	int runs[MAX_CAPTURE_RUNS];
+	int kinds[MAX_CAPTURE_RUNS];
+};
+
+struct athlete {
+	char name[ATHLETE_NAME];
+	int captures;
+	int skipped;
+	int runs;
+	int skipped_runs;
+	struct moments m[NUM_KINDS][NUM_METRICS];
+};
+
+// Worker -> parent. It's bigger than the 512 bytes a pipe's promised
+// to take in one go, so the parent reads it as it comes rather than
+// waiting for the worker to exit first.
+struct partial {
+	int32_t runs;
+	int32_t skipped;
+	struct moments m[NUM_KINDS][NUM_METRICS];
+};
+
+struct slot {
+	pid_t pid;
+	int fd;
+	struct capture *c;
+
+	struct partial p;
+	size_t got;		// bytes of p so far
+};
+
+static struct capture captures[MAX_CAPTURES] = { 0 };
+static int ncaptures = 0;
+static struct athlete athletes[MAX_ATHLETES] = { 0 };
+static int nathletes = 0;
+static struct slot pool[MAX_POOL] = { 0 };
+
+static const char *kind_names[NUM_KINDS] = { "JUMP", "FLIP" };
+
+// MARK: Manifest
+
+static int athlete_index(const char *name) {
+	for (int i = 0; i < nathletes; i++) {
+		if (strncmp(athletes[i].name, name, ATHLETE_NAME) == 0) {
+			return i;
+		}
+	}
+
+	if (nathletes == MAX_ATHLETES) {
+		errx(1, "too many athletes");
+	} else if (strlen(name) >= ATHLETE_NAME) {
+		errx(1, "athlete name '%s' too long", name);
+	}
+
+	strncpy(athletes[nathletes].name, name, ATHLETE_NAME - 1);
+	return nathletes++;
+}
+
+static void parse_line(char *line, const char *dir, int lineno) {
+	struct capture *c = NULL;
+	char *athlete = NULL, *file = NULL, *tok = NULL;
+	const char *sep = " \t\r\n";
+	int l = 0;
+
+	// 1. Comments and blank lines
+	if (NULL == (athlete = strtok(line, sep)) || athlete[0] == '#') {
+		return;
+	} else if (NULL == (file = strtok(NULL, sep))) {
+		errx(1, "catalog line %d: no file", lineno);
+	} else if (ncaptures == MAX_CAPTURES) {
+		errx(1, "catalog too big");
+	}
+
+	c = &captures[ncaptures];
+	c->athlete = athlete_index(athlete);
+	c->seq = athletes[c->athlete].captures++;
+
+	if (file[0] == '/') {
+		l = snprintf(c->path, sizeof(c->path), "%s", file);
+	} else {
+		l = snprintf(c->path, sizeof(c->path), "%s/%s", dir, file);
+	}
+
+	if (l < 0 || (size_t)l >= sizeof(c->path)) {
+		errx(1, "catalog line %d: path too long", lineno);
+	}
+
+	// 2. Runs
+	while (NULL != (tok = strtok(NULL, sep))) {
+		char *eptr = NULL;
+		long run = 0;
+
+		if (c->nruns == MAX_CAPTURE_RUNS) {
+			errx(1, "catalog line %d: too many runs", lineno);
+		} else if (tok[0] == 'j') {
+			c->kinds[c->nruns] = KIND_JUMP;
+		} else if (tok[0] == 'f') {
+			c->kinds[c->nruns] = KIND_FLIP;
+		} else {
+			errx(1, "catalog line %d: bad run '%s'", lineno, tok);
+		}
+
+		run = strtol(tok + 1, &eptr, 10);
+		if (eptr == tok + 1 || *eptr != '\0' || run <= 0 || run > INT_MAX) {
+			errx(1, "catalog line %d: bad run '%s'", lineno, tok);
+		}
+
+		c->runs[c->nruns++] = (int)run;
+	}
+
+	if (c->nruns == 0) {
+		errx(1, "catalog line %d: no runs", lineno);
+	}
+
+	ncaptures++;
+}
+
+static void load_catalog(const char *catalog) {
+	static char manifest[PATH_MAX] = { 0 };
+	static char dir[PATH_MAX] = { 0 };
+	char line[BUFSIZ] = { 0 };
+	struct stat sb = { 0 };
+	char *slash = NULL;
+	FILE *fp = NULL;
+	int lineno = 0;
+
+	// 1. Where's the manifest, and what's it relative to?
+	if (stat(catalog, &sb) != 0) {
+		err(1, "%s", catalog);
+	}
+
+	if (S_ISDIR(sb.st_mode)) {
+		snprintf(dir, sizeof(dir), "%s", catalog);
+		snprintf(manifest, sizeof(manifest), "%s/%s", catalog, CATALOG_FILE);
+	} else {
+		snprintf(manifest, sizeof(manifest), "%s", catalog);
+		snprintf(dir, sizeof(dir), "%s", catalog);
+		if (NULL == (slash = strrchr(dir, '/'))) {
+			snprintf(dir, sizeof(dir), ".");
+		} else {
+			*slash = '\0';
+		}
+	}
+
+	// 2. Read it
+	if (NULL == (fp = fopen(manifest, "r"))) {
+		err(1, "%s", manifest);
+	}
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineno++;
+		if (strchr(line, '\n') == NULL && feof(fp) == 0) {
+			errx(1, "catalog line %d too long", lineno);
+		}
+
+		parse_line(line, dir, lineno);
+	}
+
+	if (ferror(fp) != 0) {
+		err(1, "%s", manifest);
+	}
+
+	fclose(fp);
+
+	if (ncaptures == 0) {
+		errx(1, "%s: empty catalog", manifest);
+	}
+}
+
+// MARK: Workers
+
+// Everything run i reports, or nonzero if any of it fails. Either the
+// whole run counts or none of it does.
+static int run_metrics(const struct capture *c, int i, struct result *out) {
+	struct bf_error e = { 0 };
+
+	for (int m = 0; m < NUM_METRICS; m++) {
+		if (phy_reports(m, c->kinds[i] == KIND_FLIP) == 0) {
+			continue;
+		} else if (cache_get(c->runs[i], m, &out[m]) == 0) {
+			continue;
+		} else if (bf_metric(c->runs[i], m, &out[m], &e) != BF_OK) {
+			warnx("%s: run %d: %s, skipping", c->path, c->runs[i], e.msg);
+			return -1;
+		}
+
+		cache_put(c->runs[i], m, out[m]);
+	}
+
+	return 0;
+}
+
+static void worker_main(int fd, const struct capture *c) {
+	struct partial p = { 0 };
+	struct bf_error e = { 0 };
+
+	if (bf_open(c->path, &e) != BF_OK) {
+		warnx("%s", e.msg);
+		exit(1);
+	}
+
+	cache_bind(c->path);
+
+	for (int i = 0; i < c->nruns; i++) {
+		struct result r[NUM_METRICS] = { 0 };
+
+		if (run_metrics(c, i, r) != 0) {
+			p.skipped++;
+			continue;
+		}
+
+		for (int m = 0; m < NUM_METRICS; m++) {
+			if (phy_reports(m, c->kinds[i] == KIND_FLIP) != 0) {
+				moments_add(&p.m[c->kinds[i]][m], c->seq, r[m].value);
+			}
+		}
+
+		p.runs++;
+	}
+
+	bf_close();
+
+	for (size_t off = 0; off < sizeof(p);) {
+		ssize_t n = write(fd, (char *)&p + off, sizeof(p) - off);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		} else if (n <= 0) {
+			err(1, "worker write");
+		}
+
+		off += (size_t)n;
+	}
+
+	exit(0);
+}
+
+static void launch(struct slot *s, struct capture *c) {
+	int fds[2] = { -1, -1 };
+
+	assert(s->pid == 0);
+
+	if (pipe(fds) != 0) {
+		err(1, "pipe");
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	switch (s->pid = fork()) {
+		case -1:
+			err(1, "fork");
+		case 0:
+			close(fds[0]);
+			for (int i = 0; i < MAX_POOL; i++) {
+				if (pool[i].pid > 0 && &pool[i] != s) {
+					close(pool[i].fd);
+				}
+			}
+
+			worker_main(fds[1], c);
+			// never reached
+			assert(0);
+		default:
+			break;
+	}
+
+	close(fds[1]);
+	s->fd = fds[0];
+	s->c = c;
+}
+
+// Read whatever's waiting from one worker. Nonzero once it's hung up.
+static int drain(struct slot *s) {
+	char extra = 0;
+	ssize_t n = 0;
+
+	if (s->got < sizeof(s->p)) {
+		n = read(s->fd, (char *)&s->p + s->got, sizeof(s->p) - s->got);
+	} else {
+		n = read(s->fd, &extra, 1);
+	}
+
+	if (n < 0 && errno == EINTR) {
+		return 0;
+	} else if (n < 0) {
+		err(1, "worker read");
+	} else if (n == 0) {
+		return 1;
+	} else if (s->got == sizeof(s->p)) {
+		// More than a partial's worth, so it isn't one
+		s->got = 0;
+		return 1;
+	}
+
+	s->got += (size_t)n;
+	return 0;
+}
+
+// Wait for somebody to finish, and fold in what they found
+static void reap(void) {
+	struct athlete *a = NULL;
+	struct slot *s = NULL;
+	int status = 0;
+
+	// 1. Who's done? Reading as we go, so nobody's stuck on a full pipe.
+	while (s == NULL) {
+		struct pollfd pfds[MAX_POOL] = { 0 };
+		struct slot *slots[MAX_POOL] = { 0 };
+		nfds_t n = 0;
+
+		for (int i = 0; i < MAX_POOL; i++) {
+			if (pool[i].pid > 0) {
+				pfds[n].fd = pool[i].fd;
+				pfds[n].events = POLLIN;
+				slots[n++] = &pool[i];
+			}
+		}
+
+		assert(n > 0);
+		if (poll(pfds, n, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err(1, "poll");
+		}
+
+		for (nfds_t i = 0; i < n && s == NULL; i++) {
+			if (pfds[i].revents != 0 && drain(slots[i]) != 0) {
+				s = slots[i];
+			}
+		}
+	}
+
+	while (waitpid(s->pid, &status, 0) < 0) {
+		if (errno != EINTR) {
+			err(1, "waitpid");
+		}
+	}
+
+	a = &athletes[s->c->athlete];
+
+	// 2. Merge, if they made it
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0 && s->got == sizeof(s->p)) {
+		for (int k = 0; k < NUM_KINDS; k++) {
+			for (int m = 0; m < NUM_METRICS; m++) {
+				moments_merge(&a->m[k][m], &s->p.m[k][m]);
+			}
+		}
+
+		a->runs += s->p.runs;
+		a->skipped_runs += s->p.skipped;
+	} else {
+		warnx("%s: couldn't be analyzed, skipping", s->c->path);
+		a->skipped++;
+	}
+
+	close(s->fd);
+	bzero(s, sizeof(struct slot));
+}
+
+// MARK: Report
+
+static void report(void) {
+	for (int i = 0; i < nathletes; i++) {
+		const struct athlete *a = &athletes[i];
+
+		printf("ATHLETE %s: %d captures, %d runs", a->name, a->captures, a->runs);
+		if (a->skipped > 0) {
+			printf(", %d skipped", a->skipped);
+		}
+		if (a->skipped_runs > 0) {
+			printf(", %d runs skipped", a->skipped_runs);
+		}
+		printf("\n");
+
+		for (int k = 0; k < NUM_KINDS; k++) {
+			for (int m = 0; m < NUM_METRICS; m++) {
+				const struct metric *mt = phy_metric(m);
+				const struct moments *mm = &a->m[k][m];
+
+				if (mm->n == 0) {
+					continue;
+				}
+
+				printf("  %-4s %-30s %12.6f ± %-12.6f %-8s n=%-4lld trend %+f/capture\n",
+				    kind_names[k], mt->name, mm->my, sqrt(moments_var(mm)), mt->units,
+				    (long long)mm->n, moments_slope(mm));
+			}
+		}
+
+		printf("\n");
+	}
+}
+
+void cat_run(const char *catalog, int nworkers) {
+	int next = 0, running = 0;
+
+	assert(catalog != NULL);
+
+	if (nworkers <= 0 || nworkers > MAX_POOL) {
+		errx(1, "between 1 and %d workers", MAX_POOL);
+	}
+
+	load_catalog(catalog);
+
+	while (next < ncaptures || running > 0) {
+		struct slot *s = NULL;
+
+		for (int i = 0; i < nworkers && s == NULL; i++) {
+			if (pool[i].pid == 0) {
+				s = &pool[i];
+			}
+		}
+
+		if (s != NULL && next < ncaptures) {
+			launch(s, &captures[next++]);
+			running++;
+		} else {
+			reap();
+			running--;
+		}
+	}
+
+	report();
+}
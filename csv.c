@@ -1,38 +1,104 @@
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #include <assert.h>
-#include <err.h>
 #include <errno.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <unistd.h>
 
 #include "physics.h"
 
 // "Never write your own CSV parser".
 // I know understand why. But hey! It was fun!
-// TODO:
-// => `fread_but_better` (see README)
-// => Various dialects (quoted fields) not supported but the files
-//    we're reading don't require them. So it's fine.
+//
+// Dialects: RFC 4180 quoting ("..." around a field, "" for a quote in
+// one), any one-byte delimiter (csv_set_delimiter()), LF or CRLF. Rows
+// either end in a delimiter, like the exporter's, or don't, like
+// everybody else's; the header row says which.
 
 #define TIME_FIELD "Time(s)"
 
 #define NUM_HEADERS 500
+#define HEADER_POOL (NUM_HEADERS * 64)
+
+// Every column name, so finding one doesn't mean rereading the header
+struct header_dict {
+	int loaded;
+	int n;
+	size_t off[NUM_HEADERS];
+
+	size_t used;
+	char pool[HEADER_POOL];
+};
 
 struct csv_context {
 	FILE *fp;
+	struct header_dict headers;
 
 	char cur_field[BUFSIZ];
 	int cur_run;
 
 	int ts_col;
 	int data_col;
+
+	// Watch mode: everything before tail has been consumed, and full
+	// loads don't go past it either, so refreshes don't double up rows.
+	long tail;
+
+	// Start of the appended row being parsed, for diagnostics
+	long row_start;
+
+	// Start of the last field advance() handed out, ditto
+	long cell_start;
+
+	// Whether rows end with a delimiter, like the exporter's;
+	// only good once dialect is set
+	int dialect;
+	int trailing;
 };
 
 static struct csv_context csv = { 0 };
 
+// What advance() reads from; see "Reading machinery"
+#define BLOCK 64
+#define READ_BLOCKS 1024
+#define READ_BUF (BLOCK * READ_BLOCKS)
+
+struct reader {
+	char buf[READ_BUF];
+	uint64_t ends[READ_BLOCKS];
+	size_t len;		// valid bytes in buf
+	size_t pos;		// next one up
+	long base;		// file offset of buf[0]
+	int eof;
+	int ended;		// last field ended its row with a newline
+};
+
+static struct reader rd = { 0 };
+
+// Columns loaded into memory wholesale, for anything that wants
+// random access or a tight loop over the data instead of the iterator.
+// Evicted round robin.
+#define MAX_COLUMNS 8
+
+static struct column columns[MAX_COLUMNS] = { 0 };
+static int next_column = 0;
+static unsigned long column_serial = 0;
+
+// Timestamps within this of the grid count as on it
+#define GRID_SLOP 1e-9
+
+static int pack_columns = 0;
+
+// Between fields. Quotes are always '"'.
+static char delimiter = ',';
+
+static void clear_cache(void);
+
 // MARK: Utilities
 
 void assert_desc_valid(struct desc d) {
@@ -45,6 +111,133 @@ void assert_desc_valid(struct desc d) {
 	assert(flen > 0);
 }
 
+// MARK: Column storage
+
+void csv_set_packed(int packed) {
+	pack_columns = packed;
+}
+
+int csv_packed(void) {
+	return pack_columns;
+}
+
+void csv_set_delimiter(char d) {
+	assert(d != '\0' && d != '"' && d != '\r' && d != '\n');
+	delimiter = d;
+}
+
+char csv_delimiter(void) {
+	return delimiter;
+}
+
+// Everything but the samples, which would drag every page in
+void column_clear(struct column *c) {
+	assert(c != NULL);
+
+	bzero(c, offsetof(struct column, s));
+	c->packed = pack_columns;
+}
+
+// Same column, no samples yet
+void column_rewind(struct column *c) {
+	assert(c != NULL);
+
+	c->n = 0;
+	c->irregular = 0;
+	c->t0 = 0;
+	c->dt = 0;
+}
+
+// How many samples c has room for, the way it's laid out right now
+size_t column_capacity(const struct column *c) {
+	assert(c != NULL);
+
+	if (c->packed == 0) {
+		return MAX_DATUMS;
+	} else if (c->irregular != 0) {
+		return PACKED_OFF;
+	}
+
+	return MAX_PACKED;
+}
+
+void column_push(struct column *c, double ts, double v) {
+	double grid = 0;
+	size_t i = 0;
+
+	assert(c != NULL);
+
+	if (c->n == column_capacity(c)) {
+		bf_errx(BF_ELIMIT, -1, "huge csv");
+	}
+
+	i = c->n++;
+	if (c->packed == 0) {
+		c->s.wide.ts[i] = ts;
+		c->s.wide.v[i] = v;
+		return;
+	}
+
+	// 1. Value, narrowed
+	c->s.packed[i] = (float)v;
+
+	// 2. Timestamp. The first two samples set the grid.
+	if (i == 0) {
+		c->t0 = ts;
+	} else if (i == 1) {
+		c->dt = ts - c->t0;
+	}
+
+	grid = c->t0 + (double)i * c->dt;
+	if (c->irregular == 0 && fabs(ts - grid) > GRID_SLOP) {
+		// Fell off. Everything before was on it, and offsets need
+		// the back half, so that had better be all it was.
+		if (i >= PACKED_OFF) {
+			bf_errx(BF_ELIMIT, -1, "huge csv: %s is off the grid after %zu samples, too many to pack", c->field, i);
+		}
+
+		for (size_t j = 0; j < i; j++) {
+			c->s.packed[PACKED_OFF + j] = 0;
+		}
+		c->irregular = 1;
+	}
+
+	if (c->irregular != 0) {
+		c->s.packed[PACKED_OFF + i] = (float)(ts - grid);
+	}
+}
+
+void column_copy(struct column *dst, const struct column *src) {
+	assert(dst != NULL && src != NULL);
+
+	memcpy(dst, src, offsetof(struct column, s));
+
+	if (src->packed == 0) {
+		memcpy(dst->s.wide.ts, src->s.wide.ts, src->n * sizeof(double));
+		memcpy(dst->s.wide.v, src->s.wide.v, src->n * sizeof(double));
+		return;
+	}
+
+	memcpy(dst->s.packed, src->s.packed, src->n * sizeof(float));
+	if (src->irregular != 0) {
+		memcpy(dst->s.packed + PACKED_OFF, src->s.packed + PACKED_OFF, src->n * sizeof(float));
+	}
+}
+
+// Slides the whole column along by dt, grid and all
+void column_shift(struct column *c, double dt) {
+	assert(c != NULL);
+
+	if (c->packed != 0) {
+		c->t0 += dt;
+		return;
+	}
+
+	for (size_t i = 0; i < c->n; i++) {
+		c->s.wide.ts[i] += dt;
+	}
+}
+
 // MARK: Setup/Teardown
 
 static void assert_context_inactive(void) {
@@ -73,7 +266,7 @@ void csv_initialize(char *path) {
 	assert(path != NULL);
 
 	if (NULL == (csv.fp = fopen(path, "r"))) {
-		err(1, "csv_open %s", path);
+		bf_err("csv_open %s", path);
 	}
 }
 
@@ -81,75 +274,305 @@ void csv_finalize(void) {
 	assert_context_valid(0);
 	fclose(csv.fp);
 	bzero(&csv, sizeof(struct csv_context));
+	rd.len = rd.pos = 0;
+	rd.base = 0;
+	for (int i = 0; i < MAX_COLUMNS; i++) {
+		column_clear(&columns[i]);
+	}
+	next_column = 0;
 }
 
-// MARK: Reading machinery
-
-// Return next CSV field or NULL if EOF
-static char *advance(int *newline) {
-	static char readbuf[BUFSIZ] = { 0 };
-	size_t cursor = 0;
+int csv_active(void) {
+	return csv.fp != NULL;
+}
 
-	assert(newline != NULL);
+// Somebody bailed out halfway through something. Anything loaded
+// since could be half done, so drop it; the file and header are fine.
+void csv_recover(void) {
 	assert_context_valid(0);
 
-	for (; cursor < sizeof(readbuf); cursor++) {
-		size_t ret = 0;
-
-		// 1. Pull a character out of buffer
-		// Listen. I know what you're thinking. HEY, 
-		// THIS IS TERRIBLE FOR PERFORMANCE. Well I'll
-		// have you know that `fread` implements a buffer underneath
-		// us so I'm not planning to reinvent the wheel; otherwise I
-		// would have used open(2).
-		// This SHOULD BE FINE. And if the implementation is truly brain
-		// dead then go get coffee idc.
-		ret = fread(readbuf + cursor, 1, 1, csv.fp);
-
-		// 2. Check for EOF
-		if (ret == 0) {
-			if (ferror(csv.fp) != 0) {
-				err(1, "fread");
-			} else if (feof(csv.fp) == 0) {
-				errx(1, "zero bytes read but not at eof");
+	clear_cache();
+	for (int i = 0; i < MAX_COLUMNS; i++) {
+		column_clear(&columns[i]);
+	}
+	next_column = 0;
+	csv.row_start = 0;
+
+	if (csv.headers.loaded == 0) {
+		bzero(&csv.headers, sizeof(csv.headers));
+	}
+}
+
+// Row and column (both from 1) of a byte offset, for error messages.
+// Only ever called on the way out, so just count from the top.
+void csv_locate(long offset, long *row, int *col) {
+	char chunk[BUFSIZ] = { 0 };
+	long pos = 0;
+	int quoted = 0;
+
+	assert(row != NULL && col != NULL);
+	*row = 0;
+	*col = 0;
+
+	if (csv.fp == NULL || offset < 0) {
+		return;
+	}
+
+	*row = 1;
+	*col = 1;
+
+	while (pos < offset) {
+		size_t want = (size_t)(offset - pos) < sizeof(chunk) ? (size_t)(offset - pos) : sizeof(chunk);
+		ssize_t got = pread(fileno(csv.fp), chunk, want, (off_t)pos);
+
+		if (got <= 0) {
+			return;
+		}
+
+		for (ssize_t i = 0; i < got; i++) {
+			quoted ^= chunk[i] == '"';
+
+			if (quoted != 0) {
+				continue;
+			} else if (chunk[i] == '\n') {
+				(*row)++;
+				*col = 1;
+			} else if (chunk[i] == delimiter) {
+				(*col)++;
 			}
+		}
 
-			// EOF.
-			break;
+		pos += got;
+	}
+}
 
-		} else if (readbuf[cursor] == ',') {
-			break;
+// MARK: Reading machinery
+
+// The file comes in a READ_BUF at a time, through pread(2), and each
+// 64 byte block of that gets a bitmap of where a field could end: a
+// delimiter or a newline that isn't inside quotes. Quoted or not is
+// the XOR of every quote before a byte, which for a whole block is
+// one prefix XOR over its bitmap of quotes, carried into the next;
+// escaped quotes flip it twice and come out in the wash. Finding the
+// end of a field is then a count of trailing zeros, and a file
+// without any quotes costs no more than it would if we didn't care.
+//
+// A fill keeps whatever hasn't been read yet, so a field never
+// straddles two of them. Fills only start on a field boundary, which
+// is never inside quotes, so the carry always starts out clear.
+
+// x ^ (x << 1) ^ (x << 2) ^ ... ^ (x << 63)
+static uint64_t prefix_xor(uint64_t x) {
+	for (int s = 1; s < BLOCK; s <<= 1) {
+		x ^= x << s;
+	}
+
+	return x;
+}
+
+// Branch free within a block, so the compares vectorize
+static void classify(void) {
+	const unsigned char d = (unsigned char)delimiter;
+	uint64_t carry = 0;
+	size_t nblocks = (rd.len + BLOCK - 1) / BLOCK;
+
+	for (size_t b = 0; b < nblocks; b++) {
+		const unsigned char *p = (const unsigned char *)rd.buf + b * BLOCK;
+		uint64_t quotes = 0, ends = 0, inside = 0;
+
+		for (int k = 0; k < BLOCK; k++) {
+			quotes |= (uint64_t)(p[k] == '"') << k;
+			ends |= (uint64_t)((p[k] == d) | (p[k] == '\n') | (p[k] == '\r')) << k;
 		}
+
+		inside = prefix_xor(quotes) ^ carry;
+		carry = (uint64_t)((int64_t)inside >> 63);
+		rd.ends[b] = ends & ~inside;
 	}
+}
 
-	// At the end of this loop, cursor is parked on
-	// either BUFSIZ, EOF, or a final comma.
-	// Rule out the error case first.
-	if (cursor == sizeof(readbuf)) {
-		errx(1, "big field (offset %ld)", ftell(csv.fp));
+// First unquoted delimiter or newline at or after from, or rd.len
+static size_t next_end(size_t from) {
+	size_t b = from / BLOCK, nblocks = (rd.len + BLOCK - 1) / BLOCK;
+	uint64_t m = 0;
+
+	if (from >= rd.len) {
+		return rd.len;
 	}
 
-	// Valid data will always end on a comma.
-	// If we're at EOF, I can imagine situations where
-	// we have trailing garbage.
-	if (feof(csv.fp) != 0) {
-		assert(cursor < 2); // 1 if final newline or 0
-		return NULL;
+	m = rd.ends[b] & (~0ULL << (from % BLOCK));
+	while (m == 0) {
+		if (++b == nblocks) {
+			return rd.len;
+		}
+		m = rd.ends[b];
+	}
+
+	from = b * BLOCK + (size_t)__builtin_ctzll(m);
+	return from < rd.len ? from : rd.len;
+}
+
+// 2 for CRLF, 1 for a bare LF or CR, 0 for anything else
+static size_t newline_at(size_t i) {
+	if (i >= rd.len || (rd.buf[i] != '\r' && rd.buf[i] != '\n')) {
+		return 0;
+	}
+
+	return (rd.buf[i] == '\r' && i + 1 < rd.len && rd.buf[i + 1] == '\n') ? 2 : 1;
+}
+
+// The exporter ends every row, header included, with a delimiter, and
+// the newline after it leads the next row. Everybody else ends rows
+// with the newline. The header says which this is.
+static void detect_dialect(void) {
+	for (size_t i = next_end(0); i < rd.len; i = next_end(i + 1)) {
+		if (newline_at(i) != 0) {
+			csv.trailing = i > 0 && rd.buf[i - 1] == delimiter;
+			csv.dialect = 1;
+			return;
+		}
+	}
+
+	// Header and nothing else, or one too long to tell; assume ours
+	csv.trailing = 1;
+	csv.dialect = 1;
+}
+
+// Keep what's left, top up the rest
+static void reader_fill(void) {
+	size_t keep = rd.len - rd.pos;
+
+	memmove(rd.buf, rd.buf + rd.pos, keep);
+	rd.base += (long)rd.pos;
+	rd.pos = 0;
+	rd.len = keep;
 
-	} else if (readbuf[cursor] != ',') {
-		errx(1, "no comma (offset %ld)", ftell(csv.fp));
+	while (rd.len < sizeof(rd.buf) && rd.eof == 0) {
+		ssize_t got = pread(fileno(csv.fp), rd.buf + rd.len, sizeof(rd.buf) - rd.len, (off_t)(rd.base + (long)rd.len));
+
+		if (got < 0 && errno == EINTR) {
+			continue;
+		} else if (got < 0) {
+			bf_err("read");
+		}
+
+		rd.eof = got == 0;
+		rd.len += (size_t)got;
 	}
 
-	readbuf[cursor] = '\0';
+	// Nothing past the end can look like a delimiter
+	bzero(rd.buf + rd.len, sizeof(rd.buf) - rd.len);
+	classify();
+
+	if (csv.dialect == 0 && rd.base == 0) {
+		detect_dialect();
+	}
+}
+
+static long reader_tell(void) {
+	return rd.base + (long)rd.pos;
+}
+
+// Only ever to a field boundary. Anywhere in what's buffered, we
+// stay put; the file might have grown, though, so EOF is up for
+// grabs again.
+static void reader_seek(long off) {
+	assert(off >= 0);
+
+	if (rd.len > 0 && off >= rd.base && off <= rd.base + (long)rd.len) {
+		rd.pos = (size_t)(off - rd.base);
+	} else {
+		rd.base = off;
+		rd.pos = rd.len = 0;
+	}
+
+	rd.eof = 0;
+	rd.ended = 0;
+}
+
+// Copy a quoted field out from between its quotes, "" for "
+static void unquote(char *out, size_t from, size_t to) {
+	size_t n = 0;
+
+	for (size_t i = from + 1; i < to; i++) {
+		if (rd.buf[i] != '"') {
+			out[n++] = rd.buf[i];
+		} else if (i + 1 < to && rd.buf[i + 1] == '"') {
+			out[n++] = '"';
+			i++;
+		} else if (i + 1 == to) {
+			out[n] = '\0';
+			return;
+		} else {
+			bf_errx(BF_EFORMAT, rd.base + (long)i, "junk after closing quote");
+		}
+	}
 
-	// Strip out leading newline PRN
-	if (readbuf[0] == '\r') {
+	bf_errx(BF_EFORMAT, rd.base + (long)from, "unterminated quote");
+}
+
+// Return next CSV field or NULL if EOF. newline is set if
+// the field is the first of a row, other than the header's.
+static char *advance(int *newline) {
+	static char field[BUFSIZ] = { 0 };
+	size_t end = 0, nl = 0;
+
+	assert(newline != NULL);
+	assert_context_valid(0);
+
+	// 1. Enough buffered for the biggest field we'd take, and then some
+	if (rd.len - rd.pos < sizeof(field) + 2 && rd.eof == 0) {
+		reader_fill();
+	}
+	assert(csv.dialect != 0);
+
+	*newline = rd.ended;
+	rd.ended = 0;
+
+	// 2. Newlines lead rows in the exporter's files. Something
+	// appending may well end rows with one rather than start them
+	// with it, so a last one can dangle.
+	if (csv.trailing != 0 && (nl = newline_at(rd.pos)) != 0) {
+		rd.pos += nl;
 		*newline = 1;
-		return readbuf + 2;
+	}
+
+	if (rd.pos == rd.len && rd.eof != 0) {
+		return NULL;
+	}
+
+	// 3. Find the end of it
+	end = next_end(rd.pos);
+	if (end - rd.pos >= sizeof(field)) {
+		bf_errx(BF_ELIMIT, reader_tell(), "big field");
+	} else if (end == rd.len && csv.trailing != 0 && rd.buf[rd.pos] != '"') {
+		// Valid data will always end on a delimiter
+		bf_errx(BF_EFORMAT, reader_tell(), "trailing garbage");
+	}
+
+	// 4. Copy it out
+	csv.cell_start = reader_tell();
+	if (rd.buf[rd.pos] == '"') {
+		unquote(field, rd.pos, end);
+	} else if (memchr(rd.buf + rd.pos, '"', end - rd.pos) != NULL) {
+		bf_errx(BF_EFORMAT, reader_tell(), "quote in unquoted field");
 	} else {
-		*newline = 0;
-		return readbuf;
+		memcpy(field, rd.buf + rd.pos, end - rd.pos);
+		field[end - rd.pos] = '\0';
 	}
+
+	// 5. And past it. Without the exporter's trailing delimiters, a
+	// newline (or EOF) ends the last field in a row.
+	if (end < rd.len && rd.buf[end] == delimiter) {
+		rd.pos = end + 1;
+	} else if (csv.trailing != 0) {
+		bf_errx(BF_EFORMAT, rd.base + (long)end, "no delimiter");
+	} else {
+		rd.pos = end + newline_at(end);
+		rd.ended = 1;
+	}
+
+	return field;
 }
 
 static char *advance_multiple(int n) {
@@ -163,9 +586,9 @@ static char *advance_multiple(int n) {
 		v = advance(&newline);
 
 		if (newline != 0) {
-			errx(1, "bad advance_multiple offset");
+			bf_errx(BF_EFORMAT, reader_tell(), "short row");
 		} else if (v == NULL) {
-			errx(1, "unexpected eof");
+			bf_errx(BF_EFORMAT, reader_tell(), "unexpected eof");
 		}
 	}
 
@@ -187,7 +610,7 @@ static char *advance_to_next_newline(void) {
 		}
 	}
 
-	errx(1, "too many columns in csv");
+	bf_errx(BF_ELIMIT, reader_tell(), "too many columns in csv");
 	// never reached
 }
 
@@ -202,58 +625,91 @@ static char *name_for_column(struct desc d) {
 	ret = snprintf(b, sizeof(b), "Data Set %d:%s", d.run, d.field);
 
 	if (ret < 0) {
-		err(1, "snprintf name for %d/%s", d.run, d.field);
+		bf_err("snprintf name for %d/%s", d.run, d.field);
 	} else if ((size_t)ret >= sizeof(b)) {
-		errx(1, "snprintf %d/%s too long", d.run, d.field);
+		bf_errx(BF_ELIMIT, -1, "snprintf %d/%s too long", d.run, d.field);
 	}
 
 	return b;
 }
 
-// Zero indexed column #
-static int find_column(struct desc d) {
-	char *target = NULL;
+// Read the header row into the dictionary, once per file
+static void load_headers(void) {
 	long saved_position = 0;
-	int found_col = -1;
+	int saved_ended = 0;
 
 	assert_context_valid(0);
-	assert_desc_valid(d);
+	assert(csv.headers.loaded == 0);
 
 	// 1. Back up our current position in the file
-	saved_position = ftell(csv.fp);
-	if (saved_position < 0) {
-		err(1, "fgetpos");
-	}
-	rewind(csv.fp);
-
-	// 2. Figure out the name of what we want
-	target = name_for_column(d);
+	saved_position = reader_tell();
+	saved_ended = rd.ended;
+	reader_seek(0);
 
-	// 3. Find it
+	// 2. Slurp
 	for (int col = 0; col < NUM_HEADERS; col++) {
 		int newline = 0;
 		char *v = advance(&newline);
+		size_t l = 0;
 
 		if (v == NULL || newline > 0) {
 			break;
 		}
 
-		if (strncmp(v, target, BUFSIZ) == 0) {
-			found_col = col;
-			break;
+		l = strnlen(v, BUFSIZ) + 1;
+		if (csv.headers.used + l > sizeof(csv.headers.pool)) {
+			bf_errx(BF_ELIMIT, reader_tell(), "headers too long");
 		}
+
+		memcpy(csv.headers.pool + csv.headers.used, v, l);
+		csv.headers.off[col] = csv.headers.used;
+		csv.headers.used += l;
+		csv.headers.n++;
+	}
+
+	csv.headers.loaded = 1;
+
+	// 3. Restore
+	reader_seek(saved_position);
+	rd.ended = saved_ended;
+}
+
+// Zero indexed column #, or -1 if it isn't there
+static int lookup_column(struct desc d) {
+	char *target = NULL;
+
+	assert_context_valid(0);
+	assert_desc_valid(d);
+
+	if (csv.headers.loaded == 0) {
+		load_headers();
 	}
 
-	if (found_col < 0) {
-		errx(1, "can't find column '%s'", target);
+	target = name_for_column(d);
+	for (int col = 0; col < csv.headers.n; col++) {
+		if (strncmp(csv.headers.pool + csv.headers.off[col], target, BUFSIZ) == 0) {
+			return col;
+		}
 	}
 
-	// 4. Restore
-	if (fseek(csv.fp, saved_position, SEEK_SET) != 0) {
-		err(1, "fseek");
+	return -1;
+}
+
+static int find_column(struct desc d) {
+	int col = lookup_column(d);
+
+	if (col < 0) {
+		bf_errx(BF_ECOLUMN, -1, "can't find column '%s'", name_for_column(d));
 	}
 
-	return found_col;
+	return col;
+}
+
+int csv_has_column(struct desc d) {
+	assert_context_valid(0);
+	assert_desc_valid(d);
+
+	return lookup_column(d) >= 0;
 }
 
 // MARK: Selecting columns
@@ -274,6 +730,11 @@ static void set_columns_wo_cache(struct desc d) {
 
 	csv.ts_col = find_column(time_d);
 	csv.data_col = find_column(d);
+
+	// Rows get read left to right, once
+	if (csv.ts_col >= csv.data_col) {
+		bf_errx(BF_EFORMAT, -1, "time for run %d comes after %s", d.run, d.field);
+	}
 	assert_context_valid(1);
 	clear_cache();
 }
@@ -293,13 +754,23 @@ static int set_columns_with_cache(struct desc d) {
 
 	// 2. Nope. Update.
 	set_columns_wo_cache(d);
-	strncpy(csv.cur_field, d.field, fsize);
+	snprintf(csv.cur_field, fsize, "%s", d.field);
 	csv.cur_run = d.run;
 	return 0;
 }
 
 // MARK: Iterator
 
+// Where a bad cell starts. Appended rows aren't where the reader is;
+// for those, the row will do.
+static long cell_offset(void) {
+	if (csv.row_start > 0) {
+		return csv.row_start;
+	}
+
+	return csv.cell_start;
+}
+
 // Return -1 if empty row, 0 w/ populated dout otherwise
 static int parse_cell(char *cell, double *dout) {
 	char *eptr = NULL;
@@ -313,12 +784,23 @@ static int parse_cell(char *cell, double *dout) {
 		return -1;
 	}
 
+	// Anybody splitting on something else is probably doing it to
+	// write 1,5 for 1.5. Thousands separators come out as 1.600.5,
+	// which won't parse all the way, so they don't get misread.
+	if (delimiter != ',') {
+		for (char *p = strchr(cell, ','); p != NULL; p = strchr(p, ',')) {
+			*p = '.';
+		}
+	}
+
+	// Whatever set errno last, it wasn't this cell
+	errno = 0;
 	d = strtod(cell, &eptr);
-	if (eptr == cell) {
-		errx(1, "bad cell '%s'", cell);
+	if (eptr == cell || *eptr != '\0') {
+		bf_errx(BF_EFORMAT, cell_offset(), "bad cell '%s'", cell);
 	} else if (errno == ERANGE) {
 		char *desc = (d == HUGE_VAL) ? "huge" : "tiny";
-		errx(1, "%s cell '%s'", desc, cell);
+		bf_errx(BF_EFORMAT, cell_offset(), "%s cell '%s'", desc, cell);
 	}
 
 	*dout = d;
@@ -374,11 +856,11 @@ struct datum *csv_iterate(struct desc d) {
 	// 1. Make sure we're in the right place
 	continuing = set_columns_with_cache(d);
 	if (continuing == 0) {
-		rewind(csv.fp);
+		reader_seek(0);
 	}
 
 	// 2. Go!
-	for (int i = 0; i < MAX_DATUMS; i++) {
+	for (int i = 0; i < MAX_SAMPLES; i++) {
 		ret = rnr(&dout);
 		switch (ret) {
 			case RNR_OK:
@@ -401,3 +883,451 @@ void csv_stopiter(void) {
 	assert_context_valid(1);
 	clear_cache();
 }
+
+// MARK: Loaded columns
+
+static struct column *resident_column(struct desc d) {
+	for (int i = 0; i < MAX_COLUMNS; i++) {
+		struct column *c = &columns[i];
+		if (c->run == d.run && strncmp(c->field, d.field, sizeof(c->field)) == 0) {
+			return c;
+		}
+	}
+
+	return NULL;
+}
+
+// Next round robin slot that isn't holding something we were asked for
+static struct column *evict_column(int run, const char **fields, int n) {
+	for (int tries = 0; tries < MAX_COLUMNS; tries++) {
+		struct column *c = &columns[next_column];
+		int wanted = 0;
+
+		next_column = (next_column + 1) % MAX_COLUMNS;
+
+		for (int i = 0; i < n; i++) {
+			struct desc d = { .run = run, .field = fields[i] };
+			wanted |= (c == resident_column(d));
+		}
+
+		if (wanted == 0) {
+			column_clear(c);
+			return c;
+		}
+	}
+
+	// never reached; n < MAX_COLUMNS
+	assert(0);
+}
+
+// Load every column in one pass over the file. cols and outcols
+// must be sorted by column number.
+static void load_columns(int run, int *cols, struct column **outcols, int n) {
+	int ts_col = 0;
+	struct desc time_d = {
+		.run = run,
+		.field = TIME_FIELD,
+	};
+
+	assert(n > 0 && n < MAX_COLUMNS);
+
+	ts_col = find_column(time_d);
+	if (ts_col >= cols[0]) {
+		bf_errx(BF_EFORMAT, -1, "time for run %d comes after its data", run);
+	}
+
+	// We're about to yank the file out from under the iterator
+	clear_cache();
+	reader_seek(0);
+
+	for (int i = 0; i < n; i++) {
+		outcols[i]->col = cols[i];
+		outcols[i]->ts_col = ts_col;
+	}
+
+	for (int row = 0; row < MAX_SAMPLES; row++) {
+		double ts = 0;
+		int cur = 0;
+		char *v = NULL;
+
+		if (csv.tail > 0 && reader_tell() >= csv.tail) {
+			return;
+		} else if (NULL == (v = advance_to_next_newline())) {
+			return;
+		}
+
+		// 1. Timestamp, same as rnr(): missing means this run's done
+		if (ts_col > 0) {
+			v = advance_multiple(ts_col);
+		}
+		if (parse_cell(v, &ts) != 0) {
+			for (int i = 0; i < n; i++) {
+				outcols[i]->ended = 1;
+			}
+			return;
+		}
+		cur = ts_col;
+
+		// 2. Everything else, left to right
+		for (int i = 0; i < n; i++) {
+			struct column *c = outcols[i];
+			double value = 0;
+
+			v = advance_multiple(cols[i] - cur);
+			cur = cols[i];
+
+			if (parse_cell(v, &value) != 0) {
+				continue;
+			}
+
+			column_push(c, ts, value);
+		}
+	}
+
+	bf_errx(BF_ELIMIT, -1, "huge csv");
+}
+
+// Make fields of run resident, reading the file at most once
+// for all of them. Results land in out in the order asked for.
+void csv_columns(int run, const char **fields, int n, const struct column **out) {
+	int cols[MAX_COLUMNS] = { 0 };
+	struct column *outcols[MAX_COLUMNS] = { 0 };
+	int nload = 0;
+
+	assert_context_valid(0);
+	assert(fields != NULL && out != NULL);
+	assert(n > 0 && n < MAX_COLUMNS);
+
+	// 1. Figure out what's missing
+	for (int i = 0; i < n; i++) {
+		struct desc d = { .run = run, .field = fields[i] };
+		struct column *c = NULL;
+
+		assert_desc_valid(d);
+
+		if (NULL != (out[i] = resident_column(d))) {
+			continue;
+		}
+
+		// Already asked for this one?
+		for (int j = 0; j < nload; j++) {
+			if (strncmp(outcols[j]->field, d.field, BUFSIZ) == 0) {
+				c = outcols[j];
+			}
+		}
+
+		if (c == NULL) {
+			c = evict_column(run, fields, n);
+			c->run = run;
+			c->serial = c->origin = ++column_serial;
+			strncpy(c->field, d.field, sizeof(c->field) - 1);
+
+			cols[nload] = find_column(d);
+			outcols[nload] = c;
+			nload++;
+		}
+
+		out[i] = c;
+	}
+
+	if (nload == 0) {
+		return;
+	}
+
+	// 2. Sort by column number, so one pass reads left to right
+	for (int i = 1; i < nload; i++) {
+		for (int j = i; j > 0 && cols[j - 1] > cols[j]; j--) {
+			int tc = cols[j];
+			struct column *tp = outcols[j];
+
+			cols[j] = cols[j - 1];
+			outcols[j] = outcols[j - 1];
+			cols[j - 1] = tc;
+			outcols[j - 1] = tp;
+		}
+	}
+
+	// 3. Go!
+	load_columns(run, cols, outcols, nload);
+}
+
+const struct column *csv_column(struct desc d) {
+	const struct column *c = NULL;
+
+	assert_desc_valid(d);
+	csv_columns(d.run, &d.field, 1, &c);
+	return c;
+}
+
+// MARK: Watching
+
+// Rows in watch mode get picked up a chunk at a time from the tail, and
+// have to be whole (one field per header) before we believe them.
+#define TAIL_CHUNK (64 * 1024)
+#define MAX_ROW (NUM_HEADERS * 64)
+
+static long file_size(void) {
+	struct stat sb = { 0 };
+
+	if (fstat(fileno(csv.fp), &sb) != 0) {
+		bf_err("fstat");
+	}
+
+	return (long)sb.st_size;
+}
+
+// Run number for a timestamp column, or 0 if it isn't one
+static int time_column_run(int col) {
+	const char *name = NULL, *suffix = ":" TIME_FIELD;
+	size_t l = 0, sl = strlen(suffix);
+	int run = 0;
+
+	assert(col >= 0 && col < csv.headers.n);
+	name = csv.headers.pool + csv.headers.off[col];
+	l = strnlen(name, BUFSIZ);
+
+	if (l <= sl || strcmp(name + l - sl, suffix) != 0) {
+		return 0;
+	} else if (sscanf(name, "Data Set %d:", &run) != 1 || run <= 0) {
+		return 0;
+	}
+
+	return run;
+}
+
+static void note_change(struct csv_change *changes, int *nchanges, int max, int run, double ts) {
+	for (int i = 0; i < *nchanges; i++) {
+		if (changes[i].run == run) {
+			changes[i].since = fmin(changes[i].since, ts);
+			return;
+		}
+	}
+
+	if (*nchanges == max) {
+		bf_errx(BF_ELIMIT, -1, "too many runs changed at once");
+	}
+
+	changes[*nchanges].run = run;
+	changes[*nchanges].since = ts;
+	(*nchanges)++;
+}
+
+// One complete appended row, fields already split
+static void take_row(char **fields, struct csv_change *changes, int *nchanges, int max) {
+	// 1. Who got new data?
+	for (int col = 0; col < csv.headers.n; col++) {
+		double ts = 0;
+		int run = time_column_run(col);
+
+		if (run > 0 && parse_cell(fields[col], &ts) == 0) {
+			note_change(changes, nchanges, max, run, ts);
+		}
+	}
+
+	// 2. Extend whatever's resident
+	for (int i = 0; i < MAX_COLUMNS; i++) {
+		struct column *c = &columns[i];
+		double ts = 0, value = 0;
+
+		if (c->run == 0 || c->ended != 0) {
+			continue;
+		}
+
+		if (parse_cell(fields[c->ts_col], &ts) != 0) {
+			c->ended = 1;
+			continue;
+		} else if (parse_cell(fields[c->col], &value) != 0) {
+			continue;
+		}
+
+		column_push(c, ts, value);
+		c->serial = ++column_serial;
+	}
+}
+
+// Everything up to the end of the last whole row is fair game. Returns
+// -1 if there isn't even a header yet, e.g. mid rewrite.
+int csv_watch(void) {
+	static char chunk[TAIL_CHUNK] = { 0 };
+	long size = 0, start = 0;
+	size_t got = 0, last_nl = 0, delims = 0;
+	ssize_t r = 0;
+	int found_nl = 0;
+
+	assert_context_valid(0);
+
+	// 1. Look at the end of the file
+	size = file_size();
+	start = (size > (long)sizeof(chunk)) ? size - (long)sizeof(chunk) : 0;
+
+	while ((r = pread(fileno(csv.fp), chunk, sizeof(chunk), (off_t)start)) < 0 && errno == EINTR) {
+		continue;
+	}
+	if (r < 0) {
+		bf_err("read");
+	}
+	got = (size_t)r;
+	reader_seek(0);
+	clear_cache();
+
+	// 2. Find the start of the last row
+	for (size_t i = 0; i < got; i++) {
+		if (chunk[i] == '\n') {
+			last_nl = i;
+			found_nl = 1;
+		}
+	}
+
+	if (found_nl == 0 && start == 0) {
+		return -1;
+	} else if (found_nl == 0) {
+		bf_errx(BF_ELIMIT, start, "no whole rows in the last %zu bytes", sizeof(chunk));
+	}
+
+	if (csv.headers.loaded == 0) {
+		load_headers();
+	}
+
+	// 3. Is it all there? Without trailing delimiters, there's no
+	// telling until its newline shows up. Either way this doesn't
+	// know about newlines in quotes; neither does csv_refresh().
+	for (size_t i = last_nl + 1; i < got; i++) {
+		delims += (chunk[i] == delimiter);
+	}
+
+	if (csv.trailing == 0) {
+		csv.tail = start + (long)last_nl + 1;
+	} else if (delims == (size_t)csv.headers.n) {
+		csv.tail = size;
+	} else {
+		size_t end = last_nl;
+
+		// ...nope. Back up to before the newline that starts it.
+		if (end > 0 && chunk[end - 1] == '\r') {
+			end--;
+		}
+		csv.tail = start + (long)end;
+	}
+
+	return 0;
+}
+
+// Quoting, a byte at a time; appended rows don't come in bulk
+#define Q_OUT 0
+#define Q_IN 1
+#define Q_CLOSING 2	// a quote in quotes: the end, or half of ""
+
+static void put_byte(char *row, size_t *rowlen, char ch, long pos) {
+	if (*rowlen == MAX_ROW) {
+		bf_errx(BF_ELIMIT, pos, "big row");
+	}
+
+	row[(*rowlen)++] = ch;
+}
+
+// Consume rows appended since last time. Runs with new data land in
+// changes, with the earliest new timestamp for each. Returns how many,
+// or -1 if the file went backwards and everything has to be reloaded.
+// partial is set if there's half a row sitting at the end.
+int csv_refresh(struct csv_change *changes, int max, int *partial) {
+	static char chunk[TAIL_CHUNK] = { 0 };
+	static char row[MAX_ROW] = { 0 };
+	char *fields[NUM_HEADERS] = { 0 };
+	long size = 0, pos = 0;
+	size_t rowlen = 0;
+	long row_begin = 0;
+	int nchanges = 0, nfields = 0, inrow = 0, quote = Q_OUT;
+
+	assert_context_valid(0);
+	assert(changes != NULL && partial != NULL);
+	assert(csv.tail > 0);
+
+	*partial = 0;
+
+	size = file_size();
+	if (size < csv.tail) {
+		return -1;
+	} else if (size == csv.tail) {
+		return 0;
+	}
+
+	// 1. Chew through what's new a chunk at a time, from where we left off
+	for (pos = csv.tail; pos < size;) {
+		ssize_t got = pread(fileno(csv.fp), chunk, sizeof(chunk), (off_t)pos);
+
+		if (got < 0 && errno == EINTR) {
+			continue;
+		} else if (got < 0) {
+			bf_err("read");
+		} else if (got == 0) {
+			break;
+		}
+
+		for (ssize_t i = 0; i < got; i++) {
+			char ch = chunk[i];
+			int nl = ch == '\r' || ch == '\n';
+
+			pos++;
+
+			// 2. Quoted stuff goes in as is
+			if (quote == Q_CLOSING && ch == '"') {
+				put_byte(row, &rowlen, ch, pos);
+				quote = Q_IN;
+				continue;
+			} else if (quote == Q_CLOSING) {
+				quote = Q_OUT;
+			} else if (quote == Q_IN) {
+				if (ch == '"') {
+					quote = Q_CLOSING;
+				} else {
+					put_byte(row, &rowlen, ch, pos);
+				}
+				continue;
+			}
+
+			// 3. Newlines lead rows in the exporter's files; elsewhere
+			// they end them, and there might be an LF after the CR
+			if (inrow == 0 && nl) {
+				continue;
+			} else if (inrow == 0) {
+				inrow = 1;
+				row_begin = pos - 1;
+				fields[0] = row;
+			}
+
+			if (ch == '"') {
+				quote = Q_IN;
+				continue;
+			} else if (nl && csv.trailing != 0) {
+				bf_errx(BF_EFORMAT, pos, "short row");
+			} else if (ch != delimiter && nl == 0) {
+				put_byte(row, &rowlen, ch, pos);
+				continue;
+			}
+
+			// 4. End of a field
+			put_byte(row, &rowlen, '\0', pos);
+			if (++nfields < csv.headers.n) {
+				if (nl) {
+					bf_errx(BF_EFORMAT, pos, "short row");
+				}
+				fields[nfields] = row + rowlen;
+				continue;
+			} else if (csv.trailing == 0 && nl == 0) {
+				bf_errx(BF_EFORMAT, pos, "long row");
+			}
+
+			// End of a row!
+			csv.row_start = row_begin;
+			take_row(fields, changes, &nchanges, max);
+			csv.row_start = 0;
+			csv.tail = pos;
+			rowlen = 0;
+			nfields = 0;
+			inrow = 0;
+		}
+	}
+
+	*partial = inrow;
+	return nchanges;
+}
@@ -0,0 +1,211 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <strings.h>
+
+#include "physics.h"
+
+// libbackflip: csv.c, math.c, sig.c and phy.c, minus the exiting.
+//
+// The core still bails out the way it always has, just through bf_err
+// and bf_errx instead of err(3) and errx(3). Outside of a bf_* call
+// they're no different. Inside one, they longjmp back out to it, the
+// capture's caches get thrown away, and the caller gets an error code
+// and a bf_error to look at. The capture stays open, so asking about
+// another run (or another capture) picks up where things left off.
+//
+// Everything underneath is static buffers, so it's one capture at a
+// time, from one thread.
+
+static jmp_buf *recovery = NULL;
+static struct bf_error last = { 0 };
+
+// MARK: Failing
+
+__attribute__((__noreturn__))
+static void vfail(int code, long offset, const char *fmt, va_list ap, int with_errno) {
+	int saved = errno;
+	size_t l = 0;
+
+	bzero(&last, sizeof(last));
+	last.code = code;
+	last.offset = offset;
+
+	vsnprintf(last.msg, sizeof(last.msg), fmt, ap);
+	l = strnlen(last.msg, sizeof(last.msg));
+
+	if (with_errno != 0) {
+		snprintf(last.msg + l, sizeof(last.msg) - l, ": %s", strerror(saved));
+		l = strnlen(last.msg, sizeof(last.msg));
+	}
+
+	if (offset >= 0) {
+		csv_locate(offset, &last.row, &last.col);
+		snprintf(last.msg + l, sizeof(last.msg) - l, " (row %ld, column %d, offset %ld)",
+		    last.row, last.col, offset);
+	}
+
+	if (recovery == NULL) {
+		errx(1, "%s", last.msg);
+	}
+
+	longjmp(*recovery, 1);
+}
+
+void bf_errx(int code, long offset, const char *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfail(code, offset, fmt, ap, 0);
+	// never reached
+	va_end(ap);
+}
+
+void bf_err(const char *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfail(BF_EIO, -1, fmt, ap, 1);
+	// never reached
+	va_end(ap);
+}
+
+// Back from a longjmp: clean up, report
+static int caught(struct bf_error *e) {
+	recovery = NULL;
+	csv_recover();
+
+	if (e != NULL) {
+		*e = last;
+	}
+
+	return last.code;
+}
+
+// Errors caught before anything gets called
+static int refuse(struct bf_error *e, int code, const char *msg) {
+	if (e != NULL) {
+		bzero(e, sizeof(struct bf_error));
+		e->code = code;
+		e->offset = -1;
+		snprintf(e->msg, sizeof(e->msg), "%s", msg);
+	}
+
+	return code;
+}
+
+// MARK: API
+
+int bf_open(const char *path, struct bf_error *e) {
+	FILE *fp = NULL;
+
+	if (path == NULL) {
+		return refuse(e, BF_EINVAL, "no path");
+	} else if (NULL == (fp = fopen(path, "r"))) {
+		char msg[BF_MSG] = { 0 };
+
+		snprintf(msg, sizeof(msg), "%s: %s", path, strerror(errno));
+		return refuse(e, BF_EIO, msg);
+	}
+
+	// Checked it opens, so csv_initialize can't fail
+	fclose(fp);
+	bf_close();
+	csv_initialize((char *)path);
+	return BF_OK;
+}
+
+int bf_metric(int run, int metric, struct result *out, struct bf_error *e) {
+	jmp_buf env;
+
+	if (csv_active() == 0) {
+		return refuse(e, BF_EINVAL, "no capture open");
+	} else if (run <= 0 || metric < 0 || metric >= NUM_METRICS || out == NULL) {
+		return refuse(e, BF_EINVAL, "bad run or metric");
+	}
+
+	if (setjmp(env) != 0) {
+		return caught(e);
+	}
+
+	recovery = &env;
+	*out = phy_metric(metric)->f(run);
+	recovery = NULL;
+	return BF_OK;
+}
+
+int bf_comdrop(int run, trajf traj, void *ctx, struct datum *out, struct bf_error *e) {
+	jmp_buf env;
+
+	if (csv_active() == 0) {
+		return refuse(e, BF_EINVAL, "no capture open");
+	} else if (run <= 0 || out == NULL) {
+		return refuse(e, BF_EINVAL, "bad run");
+	}
+
+	if (setjmp(env) != 0) {
+		return caught(e);
+	}
+
+	recovery = &env;
+	*out = phy_comdrop(run, traj, ctx);
+	recovery = NULL;
+	return BF_OK;
+}
+
+int bf_sweep(int run, int flip, const double *offsets, int n, double *ub, struct result (*out)[NUM_METRICS], struct bf_error *e) {
+	jmp_buf env;
+
+	if (csv_active() == 0) {
+		return refuse(e, BF_EINVAL, "no capture open");
+	} else if (run <= 0 || offsets == NULL || ub == NULL || out == NULL) {
+		return refuse(e, BF_EINVAL, "bad run");
+	} else if (n <= 0 || n > MAX_SWEEP) {
+		return refuse(e, BF_EINVAL, "bad sweep");
+	}
+
+	for (int i = 1; i < n; i++) {
+		if (!(offsets[i] > offsets[i - 1])) {
+			return refuse(e, BF_EINVAL, "sweep offsets must ascend");
+		}
+	}
+
+	if (setjmp(env) != 0) {
+		return caught(e);
+	}
+
+	recovery = &env;
+	*ub = phy_sweep(run, flip, offsets, n, out);
+	recovery = NULL;
+	return BF_OK;
+}
+
+int bf_roll(int run, double width, double step, rollf emit, void *ctx, struct bf_error *e) {
+	jmp_buf env;
+
+	if (csv_active() == 0) {
+		return refuse(e, BF_EINVAL, "no capture open");
+	} else if (run <= 0 || emit == NULL) {
+		return refuse(e, BF_EINVAL, "bad run");
+	} else if (!(width > 0 && step > 0)) {
+		return refuse(e, BF_EINVAL, "bad window");
+	}
+
+	if (setjmp(env) != 0) {
+		return caught(e);
+	}
+
+	recovery = &env;
+	phy_roll(run, width, step, emit, ctx);
+	recovery = NULL;
+	return BF_OK;
+}
+
+void bf_close(void) {
+	if (csv_active() != 0) {
+		csv_finalize();
+	}
+}
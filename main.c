@@ -8,33 +8,534 @@
 #include <sys/types.h>
 
 #include <err.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "physics.h"
 
+// Connection to a resident daemon, if we're asking one instead
+#define DEFAULT_BUDGET_MB 256
+#define DEFAULT_WORKERS 4
+#define DEFAULT_CACHE_MB 64
+
+static int query_fd = -1;
+static char query_path[PATH_MAX] = { 0 };
+
+// Integration bounds from -b
+static int bounded = 0;
+static double bounds[2] = { 0 };
+
+// Upper bound offsets from -W, in seconds
+#define DEFAULT_SWEEP_STEP_MS 1
+
+static double sweep[MAX_SWEEP] = { 0 };
+static int nsweep = 0;
+
+// Sliding windows from -R, in seconds
+#define DEFAULT_ROLL_STEP_MS 10
+
+static double roll_width = 0;
+static double roll_step = 0;
+
+struct roll_out {
+	int run;
+	int flip;
+};
+
+// Where COM trajectories go, if anywhere
+struct traj_out {
+	FILE *fp;
+	int binary;
+	int decimate;
+
+	int run;
+	long step;
+};
+
+// A run we're keeping an eye on in watch mode
+#define MAX_CHANGES 64
+
+struct watched {
+	const char *kind;
+	int run;
+	int flip;
+
+	int settled;
+	int stale;
+	double horizon;		// new data after this can't change anything
+};
+
+// Binary trajectory record, host byte order
+struct traj_record {
+	int32_t run;
+	int32_t reserved;
+	double ts;
+	double vel;
+	double disp;
+};
+
 static void output_result(const char *n, const char *units, struct result r) {
 	printf("  %-35s %12.6f ± %-12.6f %s\n", n, r.value, r.ucty, units);
 }
 
+static struct result metric_result(int run, int m) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+
+	if (query_fd < 0) {
+		if (cache_get(run, m, &r) == 0) {
+			return r;
+		} else if (bf_metric(run, m, &r, &e) != BF_OK) {
+			errx(1, "%s", e.msg);
+		}
+
+		cache_put(run, m, r);
+		return r;
+	}
+
+	if (srv_query(query_fd, query_path, run, m, bounded ? bounds : NULL, &r) != SRV_OK) {
+		errx(1, "server couldn't get %s for run %d", phy_metric(m)->key, run);
+	}
+
+	return r;
+}
+
+static void traj_write(double ts, double vel, double disp, void *ctx) {
+	struct traj_out *t = (struct traj_out *)ctx;
+
+	assert(t != NULL && t->fp != NULL);
+	assert(t->decimate > 0);
+
+	if (t->step++ % t->decimate != 0) {
+		return;
+	}
+
+	if (t->binary != 0) {
+		struct traj_record rec = {
+			.run = t->run,
+			.ts = ts,
+			.vel = vel,
+			.disp = disp,
+		};
+
+		if (fwrite(&rec, sizeof(rec), 1, t->fp) != 1) {
+			err(1, "write trajectory");
+		}
+	} else if (fprintf(t->fp, "%d,%f,%f,%f\n", t->run, ts, vel, disp) < 0) {
+		err(1, "write trajectory");
+	}
+}
+
+static void output_comdrop(int run, struct traj_out *t) {
+	struct datum low = { 0 };
+	struct bf_error e = { 0 };
+
+	t->run = run;
+	t->step = 0;
+
+	if (bf_comdrop(run, &traj_write, t, &low, &e) != BF_OK) {
+		errx(1, "%s", e.msg);
+	}
+	printf("  %-35s %12.6f m at %f s\n", "COM low point", low.value, low.timestamp);
+}
+
+// Records only, no commentary
+static void output_records(int run, int flip, struct traj_out *traj) {
+	struct datum low = { 0 };
+	struct bf_error e = { 0 };
+
+	for (int m = 0; m < NUM_METRICS; m++) {
+		if (phy_reports(m, flip)) {
+			out_metric(run, flip, m, metric_result(run, m));
+		}
+	}
+
+	if (traj->fp != NULL) {
+		traj->run = run;
+		traj->step = 0;
+		if (bf_comdrop(run, &traj_write, traj, &low, &e) != BF_OK) {
+			errx(1, "%s", e.msg);
+		}
+	}
+}
+
+// The whole curve, one row per offset
+static void output_sweep(const char *kind, int run, int flip) {
+	static struct result curve[MAX_SWEEP][NUM_METRICS] = { 0 };
+	struct bf_error e = { 0 };
+	double ub = 0;
+
+	if (bf_sweep(run, flip, sweep, nsweep, &ub, curve, &e) != BF_OK) {
+		errx(1, "%s", e.msg);
+	}
+
+	if (out_format() != OUT_TEXT) {
+		for (int k = 0; k < nsweep; k++) {
+			for (int m = 0; m < NUM_METRICS; m++) {
+				if (phy_reports(m, flip)) {
+					out_sweep(run, flip, m, sweep[k], ub + sweep[k], curve[k][m]);
+				}
+			}
+		}
+
+		return;
+	}
+
+	printf("%s RUN #%d, upper bound at %f s\n", kind, run, ub);
+	printf("  %9s %10s", "offset ms", "bound s");
+
+	for (int m = 0; m < NUM_METRICS; m++) {
+		const struct metric *mt = phy_metric(m);
+		char label[64] = { 0 };
+
+		if (phy_reports(m, flip)) {
+			snprintf(label, sizeof(label), "%s (%s)", mt->key, mt->units);
+			printf("  %25s", label);
+		}
+	}
+
+	printf("\n");
+
+	for (int k = 0; k < nsweep; k++) {
+		printf("  %+9.3f %10.6f", sweep[k] * 1000, ub + sweep[k]);
+
+		for (int m = 0; m < NUM_METRICS; m++) {
+			if (phy_reports(m, flip)) {
+				printf("  %12.6f ± %10.6f", curve[k][m].value, curve[k][m].ucty);
+			}
+		}
+
+		printf("\n");
+	}
+
+	printf("\n");
+}
+
+static void roll_write(const struct roll_metrics *m, void *ctx) {
+	struct roll_out *r = (struct roll_out *)ctx;
+
+	assert(r != NULL);
+
+	if (out_format() != OUT_TEXT) {
+		out_roll(r->run, r->flip, m);
+		return;
+	}
+
+	printf("  %10.6f %10.6f  %12.6f ± %10.6f  %12.6f ± %10.6f  %12.6f ± %10.6f  %12.6f ± %10.6f\n", m->lb, m->ub,
+	    m->impulse.value, m->impulse.ucty, m->peak.value, m->peak.ucty, m->low.value, m->low.ucty, m->power.value, m->power.ucty);
+}
+
+// The whole recording, one row per window
+static void output_roll(const char *kind, int run, int flip) {
+	struct roll_out r = {
+		.run = run,
+		.flip = flip,
+	};
+	struct bf_error e = { 0 };
+
+	if (out_format() == OUT_TEXT) {
+		printf("%s RUN #%d, %g ms windows every %g ms\n", kind, run, roll_width * 1000, roll_step * 1000);
+		printf("  %10s %10s  %25s  %25s  %25s  %25s\n", "from s", "to s", "impulse (N s)", "peak (N)", "low (N)", "power (W)");
+	}
+
+	if (bf_roll(run, roll_width, roll_step, &roll_write, &r, &e) != BF_OK) {
+		errx(1, "%s", e.msg);
+	}
+
+	if (out_format() == OUT_TEXT) {
+		printf("\n");
+	}
+}
+
+static void output_run(const char *kind, int run, int flip, struct traj_out *traj) {
+	if (roll_width > 0) {
+		output_roll(kind, run, flip);
+		return;
+	} else if (nsweep > 0) {
+		output_sweep(kind, run, flip);
+		return;
+	} else if (out_format() != OUT_TEXT) {
+		output_records(run, flip, traj);
+		return;
+	}
+
+	printf("%s RUN #%d\n", kind, run);
+
+	for (int m = 0; m < NUM_METRICS; m++) {
+		const struct metric *mt = phy_metric(m);
+
+		if (phy_reports(m, flip)) {
+			output_result(mt->name, mt->units, metric_result(run, m));
+		}
+	}
+
+	if (traj->fp != NULL) {
+		output_comdrop(run, traj);
+	}
+
+	printf("\n");
+}
+
+static void watch_report(struct watched *w, struct traj_out *traj) {
+	w->stale = 0;
+
+	if ((w->settled = phy_settled(w->run, &w->horizon)) != 0) {
+		output_run(w->kind, w->run, w->flip, traj);
+	} else if (out_format() == OUT_TEXT) {
+		printf("%s RUN #%d\n  waiting for landing\n\n", w->kind, w->run);
+	}
+
+	fflush(stdout);
+	out_flush();
+	if (traj->fp != NULL) {
+		fflush(traj->fp);
+	}
+}
+
+// Recompute runs as rows get appended to the file, but only the ones
+// the new rows could possibly matter to.
+static void watch_loop(const char *csv_file, struct watched *w, int nw, struct traj_out *traj) {
+	static struct csv_change changes[MAX_CHANGES] = { 0 };
+	int wfd = watch_open(csv_file);
+	int loaded = 0;
+
+	for (int i = 0; i < nw; i++) {
+		w[i].stale = 1;
+	}
+
+	for (;; watch_wait(wfd)) {
+		int partial = 0, n = 0;
+
+		// 1. What's new?
+		if (loaded == 0) {
+			loaded = csv_watch() == 0;
+		} else if ((n = csv_refresh(changes, MAX_CHANGES, &partial)) < 0) {
+			// Truncated or rewritten: start over once it's back
+			csv_finalize();
+			csv_initialize((char *)csv_file);
+			loaded = csv_watch() == 0;
+
+			for (int i = 0; i < nw; i++) {
+				w[i].stale = 1;
+			}
+		}
+
+		// 2. Who cares?
+		for (int c = 0; c < n; c++) {
+			for (int i = 0; i < nw; i++) {
+				if (changes[c].run != w[i].run) {
+					continue;
+				} else if (w[i].settled == 0 || changes[c].since <= w[i].horizon) {
+					w[i].stale = 1;
+				}
+			}
+		}
+
+		// 3. Wait out the rest of a half-written row
+		if (loaded == 0 || partial != 0) {
+			continue;
+		}
+
+		for (int i = 0; i < nw; i++) {
+			if (w[i].stale != 0) {
+				watch_report(&w[i], traj);
+			}
+		}
+	}
+}
+
+// "lb,ub" in seconds
+static void parse_bounds(const char *s) {
+	char *eptr = NULL;
+
+	bounds[0] = strtod(s, &eptr);
+	if (eptr == s || *eptr != ',') {
+		errx(1, "bad bounds '%s'", s);
+	}
+
+	s = eptr + 1;
+	bounds[1] = strtod(s, &eptr);
+	if (eptr == s || *eptr != '\0') {
+		errx(1, "bad bounds '%s'", s);
+	} else if (!(bounds[0] >= 0 && bounds[1] > bounds[0])) {
+		errx(1, "bounds must satisfy 0 <= lb < ub");
+	}
+
+	bounded = 1;
+}
+
+// "halfwidth[,step]" in milliseconds, centered on the usual upper bound
+static void parse_sweep(const char *s) {
+	double half = 0, step = DEFAULT_SWEEP_STEP_MS;
+	const char *arg = s;
+	char *eptr = NULL;
+	long steps = 0;
+
+	half = strtod(s, &eptr);
+	if (eptr == s || (*eptr != '\0' && *eptr != ',')) {
+		errx(1, "bad sweep '%s'", arg);
+	}
+
+	if (*eptr == ',') {
+		s = eptr + 1;
+		step = strtod(s, &eptr);
+		if (eptr == s || *eptr != '\0') {
+			errx(1, "bad sweep '%s'", arg);
+		}
+	}
+
+	if (!(half > 0 && step > 0)) {
+		errx(1, "sweep width and step must be positive");
+	}
+
+	// A hair of slack so 50,0.1 doesn't come up a step short
+	steps = (long)(half / step + 1e-9);
+	if (steps < 1 || 2 * steps + 1 > MAX_SWEEP) {
+		errx(1, "sweep must be between 3 and %d points", MAX_SWEEP);
+	}
+
+	nsweep = (int)(2 * steps + 1);
+	for (int i = 0; i < nsweep; i++) {
+		sweep[i] = (double)(i - steps) * step / 1000;
+	}
+}
+
+// "width[,step]" in milliseconds
+static void parse_roll(const char *s) {
+	double width = 0, step = DEFAULT_ROLL_STEP_MS;
+	const char *arg = s;
+	char *eptr = NULL;
+
+	width = strtod(s, &eptr);
+	if (eptr == s || (*eptr != '\0' && *eptr != ',')) {
+		errx(1, "bad windows '%s'", arg);
+	}
+
+	if (*eptr == ',') {
+		s = eptr + 1;
+		step = strtod(s, &eptr);
+		if (eptr == s || *eptr != '\0') {
+			errx(1, "bad windows '%s'", arg);
+		}
+	}
+
+	if (!(width > 0 && step > 0)) {
+		errx(1, "window width and step must be positive");
+	}
+
+	roll_width = width / 1000;
+	roll_step = step / 1000;
+}
+
 static void usage(void) {
-	fprintf(stderr, "usage: backflip -c file [-j run] [-f run]\n");
+	fprintf(stderr, "usage: backflip -c file [-ey] [-b lb,ub] [-d delim] [-F filter] [-q rule] [-r interp] [-Z]\n");
+	fprintf(stderr, "                [-o format] [-t file [-D n] | -W ms[,step] | -R ms[,step]] [-Q socket | -w | -K dir [-M mb]] [-j run] [-f run]\n");
+	fprintf(stderr, "       backflip -C catalog [-P workers] [-K dir [-M mb]] [-ey] [-b lb,ub] [-d delim] [-F filter] [-q rule] [-r interp] [-Z]\n");
+	fprintf(stderr, "       backflip -S socket [-M megabytes]\n");
 	fprintf(stderr, "  -c file    CSV data file (required)\n");
 	fprintf(stderr, "  -j run     Jump run number (optional)\n");
 	fprintf(stderr, "  -f run     Flip run number (optional)\n");
+	fprintf(stderr, "  -b lb,ub   Integrate over [lb, ub] seconds instead of up to takeoff\n");
+	fprintf(stderr, "  -d delim   Field delimiter, one character or \"tab\" (default ,)\n");
+	fprintf(stderr, "  -e         Detect takeoff/landing from force, not hang time\n");
+	fprintf(stderr, "  -y         Estimate the IMU's lag behind the plate and correct for it\n");
+	fprintf(stderr, "  -F filter  Filter columns before integrating, e.g. iir:30,zp,dec=4\n");
+	fprintf(stderr, "  -q rule    Integration: trapezoid (default) or simpson\n");
+	fprintf(stderr, "  -r interp  Sensor alignment: linear (default) or cubic\n");
+	fprintf(stderr, "  -Z         Keep columns packed (float values, gridded timestamps)\n");
+	fprintf(stderr, "  -o format  text (default), jsonl, or bin records\n");
+	fprintf(stderr, "  -t file    Write COM trajectories (binary if file ends in .bin)\n");
+	fprintf(stderr, "  -D n       Only write every nth trajectory sample\n");
+	fprintf(stderr, "  -W ms,step Sweep the upper bound ms either way, in step ms (default %d)\n", DEFAULT_SWEEP_STEP_MS);
+	fprintf(stderr, "  -R ms,step Impulse, force and power over sliding ms windows, every step ms (default %d)\n", DEFAULT_ROLL_STEP_MS);
+	fprintf(stderr, "  -Q socket  Ask a resident daemon instead of reading the file here\n");
+	fprintf(stderr, "  -w         Keep watching the file, recomputing as rows get appended\n");
+	fprintf(stderr, "  -C catalog Per-athlete statistics over a manifest or directory of captures\n");
+	fprintf(stderr, "  -P n       Captures to analyze at once (default %d)\n", DEFAULT_WORKERS);
+	fprintf(stderr, "  -S socket  Run as a resident daemon listening on socket\n");
+	fprintf(stderr, "  -M mb      Daemon memory budget (default %d), or cache size (default %d)\n", DEFAULT_BUDGET_MB, DEFAULT_CACHE_MB);
+	fprintf(stderr, "  -K dir     Keep results in dir, and reuse them while the file's unchanged\n");
 	exit(1);
 }
 
 int main(int argc, char *argv[]) {
-	const char *csv_file = NULL;
+	const char *csv_file = NULL, *traj_file = NULL;
+	const char *serve_sock = NULL, *query_sock = NULL, *catalog = NULL;
+	const char *cache_dir = NULL;
+	long budget_mb = -1;
+	int nworkers = DEFAULT_WORKERS;
+	struct traj_out traj = { .decimate = 1 };
+	struct filter filter = { 0 };
+	struct watched watch[2] = { 0 };
 	int jump_run = -1, flip_run = -1;
+	int watching = 0, nwatch = 0;
+	int tuned = 0;
+	int format = OUT_TEXT;
 	int ch = 0;
 
-	while ((ch = getopt(argc, argv, "c:j:f:")) != -1) {
+	while ((ch = getopt(argc, argv, "b:C:c:D:d:eF:j:f:K:M:o:P:Q:q:R:r:S:t:W:wyZ")) != -1) {
 		switch (ch) {
+		case 'b':
+			parse_bounds(optarg);
+			break;
+		case 'C':
+			catalog = optarg;
+			break;
 		case 'c':
 			csv_file = optarg;
 			break;
+		case 'D':
+			traj.decimate = atoi(optarg);
+			if (traj.decimate <= 0) {
+				errx(1, "decimation must be positive");
+			}
+			break;
+		case 'd':
+			tuned = 1;
+			if (strcmp(optarg, "tab") == 0) {
+				csv_set_delimiter('\t');
+			} else if (strlen(optarg) == 1 && strchr("\"\r\n", optarg[0]) == NULL) {
+				csv_set_delimiter(optarg[0]);
+			} else {
+				errx(1, "bad delimiter '%s'", optarg);
+			}
+			break;
+		case 'e':
+			tuned = 1;
+			phy_set_events(EVENTS_FORCE);
+			break;
+		case 'F':
+			tuned = 1;
+			if (sig_parse_filter(optarg, &filter) != 0) {
+				errx(1, "bad filter '%s'", optarg);
+			}
+			sig_set_filter(&filter);
+			break;
+		case 'q':
+			tuned = 1;
+			if (strcmp(optarg, "trapezoid") == 0) {
+				phy_set_rule(QUAD_TRAPEZOID);
+			} else if (strcmp(optarg, "simpson") == 0) {
+				phy_set_rule(QUAD_SIMPSON);
+			} else {
+				errx(1, "unknown integration rule '%s'", optarg);
+			}
+			break;
+		case 'R':
+			parse_roll(optarg);
+			break;
+		case 'r':
+			tuned = 1;
+			if (strcmp(optarg, "linear") == 0) {
+				phy_set_interp(INTERP_LINEAR);
+			} else if (strcmp(optarg, "cubic") == 0) {
+				phy_set_interp(INTERP_CUBIC);
+			} else {
+				errx(1, "unknown interpolation '%s'", optarg);
+			}
+			break;
 		case 'j':
 			jump_run = atoi(optarg);
 			if (jump_run <= 0) {
@@ -47,6 +548,50 @@ int main(int argc, char *argv[]) {
 				errx(1, "flip run must be positive");
 			}
 			break;
+		case 'K':
+			cache_dir = optarg;
+			break;
+		case 'M':
+			budget_mb = atol(optarg);
+			if (budget_mb <= 0) {
+				errx(1, "budget must be positive");
+			}
+			break;
+		case 'o':
+			if ((format = out_parse_format(optarg)) < 0) {
+				errx(1, "unknown output format '%s'", optarg);
+			}
+			out_set_format(format);
+			break;
+		case 'P':
+			nworkers = atoi(optarg);
+			if (nworkers <= 0) {
+				errx(1, "worker count must be positive");
+			}
+			break;
+		case 'Q':
+			query_sock = optarg;
+			break;
+		case 'S':
+			serve_sock = optarg;
+			break;
+		case 't':
+			traj_file = optarg;
+			break;
+		case 'W':
+			parse_sweep(optarg);
+			break;
+		case 'w':
+			watching = 1;
+			break;
+		case 'y':
+			tuned = 1;
+			phy_set_sync(1);
+			break;
+		case 'Z':
+			tuned = 1;
+			csv_set_packed(1);
+			break;
 		default:
 			usage();
 		}
@@ -55,51 +600,139 @@ int main(int argc, char *argv[]) {
 	argc -= optind;
 	argv += optind;
 
+	if (serve_sock != NULL) {
+		if (cache_dir != NULL) {
+			errx(1, "the daemon keeps its own results");
+		} else if (tuned != 0) {
+			errx(1, "the daemon takes its settings from each query");
+		}
+
+		srv_run(serve_sock, (size_t)(budget_mb > 0 ? budget_mb : DEFAULT_BUDGET_MB) * 1024 * 1024);
+		// never reached
+	}
+
+	if (cache_dir != NULL) {
+		if (query_sock != NULL) {
+			errx(1, "the daemon keeps its own results");
+		} else if (watching != 0) {
+			errx(1, "nothing to cache while the file is changing");
+		}
+
+		cache_open(cache_dir, (size_t)(budget_mb > 0 ? budget_mb : DEFAULT_CACHE_MB) * 1024 * 1024);
+	}
+
+	if (catalog != NULL) {
+		phy_set_bounds(bounded ? bounds : NULL);
+		cat_run(catalog, nworkers);
+		return 0;
+	}
+
 	if (csv_file == NULL) {
 		usage();
 	}
 
+	if (nsweep > 0 && traj_file != NULL) {
+		errx(1, "no trajectories in a sweep");
+	} else if (roll_width > 0 && (nsweep > 0 || traj_file != NULL)) {
+		errx(1, "rolling windows go on their own");
+	} else if (roll_width > 0 && watching != 0) {
+		errx(1, "no rolling windows while the file is changing");
+	}
+
+	if (query_sock != NULL) {
+		if (nsweep > 0) {
+			errx(1, "no sweeps from the daemon");
+		} else if (roll_width > 0) {
+			errx(1, "no rolling windows from the daemon");
+		} else if (watching != 0) {
+			errx(1, "the daemon does its own watching");
+		} else if (traj_file != NULL) {
+			errx(1, "no trajectories from the daemon");
+		} else if (realpath(csv_file, query_path) == NULL) {
+			err(1, "%s", csv_file);
+		}
+
+		query_fd = srv_connect(query_sock);
+	}
+
+	// Before unveil(2), so pledge(2) doesn't need to know about it
+	if (traj_file != NULL) {
+		size_t l = strlen(traj_file);
+
+		traj.binary = l > 4 && strcmp(traj_file + l - 4, ".bin") == 0;
+		if (NULL == (traj.fp = fopen(traj_file, traj.binary ? "wb" : "w"))) {
+			err(1, "open %s", traj_file);
+		} else if (traj.binary == 0) {
+			fprintf(traj.fp, "run,time_s,velocity_mps,displacement_m\n");
+		}
+	}
+
 #ifdef __OPENBSD__
 	if (unveil(csv_file, "r") != 0) {
 		err(1, "unveil %s", csv_file);
+	} else if (cache_dir != NULL && unveil(cache_dir, "rwc") != 0) {
+		err(1, "unveil %s", cache_dir);
 	} else if (unveil(NULL, NULL)) {
 		err(1, "finish unveil");
 	}
 
-	if (pledge("stdio rpath") != 0) {
+	if (pledge(cache_dir != NULL ? "stdio rpath wpath cpath fattr flock" : "stdio rpath") != 0) {
 		err(1, "pledge");
 	}
 
 #endif // __OPENBSD__
 
 
-	printf("=== Backflip Analyzer ===\n\n");
+	if (format == OUT_TEXT) {
+		printf("=== Backflip Analyzer ===\n\n");
+	}
+
+	if (query_fd < 0) {
+		struct bf_error e = { 0 };
 
-	csv_initialize((char *)csv_file);
+		phy_set_bounds(bounded ? bounds : NULL);
+		if (bf_open(csv_file, &e) != BF_OK) {
+			errx(1, "%s", e.msg);
+		} else if (cache_dir != NULL) {
+			cache_bind(csv_file);
+		}
+	}
+
+	if (jump_run <= 0 && flip_run <= 0) {
+		errx(2, "No runs specified. Use -j for jump run or -F for flip run\n");
+	}
+
+	if (watching != 0) {
+		if (jump_run > 0) {
+			watch[nwatch++] = (struct watched){ .kind = "JUMP", .run = jump_run };
+		}
+		if (flip_run > 0) {
+			watch[nwatch++] = (struct watched){ .kind = "FLIP", .run = flip_run, .flip = 1 };
+		}
+
+		watch_loop(csv_file, watch, nwatch, &traj);
+		// never reached
+	}
 
 	if (jump_run > 0) {
-		printf("JUMP RUN #%d\n", jump_run);
-		output_result("Vertical Impulse", "N s", phy_vimpulse(jump_run));
-		output_result("Horizontal Impulse", "N s", phy_himpulse(jump_run));
-		output_result("True height achieved", "m", phy_rawheight(jump_run));
-		output_result("Height via impulse (at feet)", "m", phy_impheight(jump_run));
-		printf("\n");
+		output_run("JUMP", jump_run, 0, &traj);
 	}
 
 	if (flip_run > 0) {
-		printf("FLIP RUN #%d\n", flip_run);
-		output_result("Vertical Impulse", "N s", phy_vimpulse(flip_run));
-		output_result("Horizontal Impulse", "N s", phy_himpulse(flip_run));
-		output_result("True height achieved", "m", phy_rawheight(flip_run));
-		output_result("Height via impulse (at feet)", "m", phy_impheight(flip_run));
-		output_result("Moment of inertia", "kg m^2", phy_i(flip_run));
-		printf("\n");
+		output_run("FLIP", flip_run, 1, &traj);
 	}
 
-	if (jump_run <= 0 && flip_run <= 0) {
-		errx(2, "No runs specified. Use -j for jump run or -F for flip run\n");
+	out_flush();
+
+	if (query_fd < 0) {
+		bf_close();
+	} else {
+		close(query_fd);
+	}
+
+	if (traj.fp != NULL && fclose(traj.fp) != 0) {
+		err(1, "close %s", traj_file);
 	}
 
-	csv_finalize();
 	return 0;
 }
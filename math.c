@@ -13,6 +13,94 @@ static double intdt_ucty_term(struct datum t1, struct datum t2, double ucty) {
 	return sqrt(2) * ucty / 2 * (t2.timestamp - t1.timestamp);
 }
 
+// MARK: Dual numbers
+
+// Sources whose error is independent from one sample to the next.
+// Inside an integral these get summed in quadrature per step; everything
+// else is systematic and gets summed linearly.
+static const int ucty_per_sample[NUM_UCTY_SRCS] = {
+	[UCTY_FORCEPLATE] = 1,
+};
+
+struct dual dual_const(double value) {
+	struct dual r = { 0 };
+
+	r.value = value;
+	return r;
+}
+
+struct dual dual_source(double value, enum ucty_src src, double sigma) {
+	struct dual r = { 0 };
+
+	assert(src >= 0 && src < NUM_UCTY_SRCS);
+	assert(sigma >= 0);
+
+	r.value = value;
+	r.d[src] = sigma;
+	return r;
+}
+
+struct dual dual_add(struct dual a, struct dual b) {
+	a.value += b.value;
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		a.d[i] += b.d[i];
+	}
+
+	return a;
+}
+
+struct dual dual_sub(struct dual a, struct dual b) {
+	return dual_add(a, dual_scale(b, -1));
+}
+
+struct dual dual_mul(struct dual a, struct dual b) {
+	struct dual r = { 0 };
+
+	r.value = a.value * b.value;
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		r.d[i] = a.d[i] * b.value + a.value * b.d[i];
+	}
+
+	return r;
+}
+
+struct dual dual_div(struct dual a, struct dual b) {
+	struct dual r = { 0 };
+
+	if (b.value == 0) {
+		bf_errx(BF_EDATA, -1, "dual division by zero");
+	}
+
+	r.value = a.value / b.value;
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		r.d[i] = (a.d[i] * b.value - a.value * b.d[i]) / pow(b.value, 2);
+	}
+
+	return r;
+}
+
+struct dual dual_scale(struct dual a, double k) {
+	a.value *= k;
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		a.d[i] *= k;
+	}
+
+	return a;
+}
+
+struct result dual_result(struct dual a) {
+	struct result r = { 0 };
+	double sq_ucty_rsum = 0;
+
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		sq_ucty_rsum += pow(a.d[i], 2);
+	}
+
+	r.value = a.value;
+	r.ucty = sqrt(sq_ucty_rsum);
+	return r;
+}
+
 // MARK: Integrator
 
 struct integrator;
@@ -23,6 +111,21 @@ struct integrator {
 	double icond;
 	struct datum window[2];
 
+	// Integrand at the first and last step, for bound sensitivity
+	double edges[2];
+	int steps;
+
+	// Everything integrated so far, less the initial condition
+	double running;
+
+	// QUAD_SIMPSON: the current group of up to four steps, as points
+	// through the integrand, and the last pair of the group before
+	int rule;
+	struct datum group[5];
+	struct datum prior[2];
+	double pending;		// error estimate posted for the group so far
+	double applied;		// Simpson correction handed out for it so far
+
 	void *ctx;
 	nf next;
 	uctyf ucty;
@@ -33,34 +136,55 @@ static void assert_integrator_valid(struct integrator *in) {
 	assert(in->bounds[1] > in->bounds[0]);
 	assert(in->next != NULL);
 	assert(in->ctx != NULL);
+	assert(in->steps >= 0);
+	assert(in->rule == QUAD_TRAPEZOID || in->rule == QUAD_SIMPSON);
+}
+
+// Bounds come from the data (takeoff, landing, the load), so a bad
+// recording can hand us a backwards window; that's its problem, not ours
+static void check_bounds(double lb, double ub) {
+	if (!(lb >= 0 && ub > lb)) {
+		bf_errx(BF_EDATA, -1, "bad integration bounds %f-%f", lb, ub);
+	}
 }
 
 static struct datum find_lb(struct integrator *in, double lb) {
 	struct datum *cur = NULL;
 
-	for (int i = 0; i < MAX_DATUMS; i++) {
+	for (int i = 0; i < MAX_SAMPLES; i++) {
 		cur = in->next(in);
 		if (cur == NULL) {
-			errx(1, "oob lb %f", lb);
+			bf_errx(BF_EDATA, -1, "oob lb %f", lb);
 		} else if (cur->timestamp >= lb) {
 			break;
 		}
 	}
 
 	if (cur == NULL) {
-		errx(1, "huge csv");
+		bf_errx(BF_ELIMIT, -1, "huge csv");
 	}
 
 	return *cur;
 }
 
 
-static void integrator_init(struct integrator *in, double lb, double ub, double icond, void *ctx, nf next, uctyf ucty) {
+static void integrator_init(struct integrator *in, double lb, double ub, double icond, void *ctx, nf next, uctyf ucty, int rule) {
+	check_bounds(lb, ub);
+
 	in->bounds[0] = lb;
 	in->bounds[1] = ub;
 	in->ucty = ucty;
 	in->icond = icond;
 	bzero(in->window, sizeof(in->window));
+	bzero(in->edges, sizeof(in->edges));
+	in->steps = 0;
+	in->running = 0;
+
+	in->rule = rule;
+	bzero(in->group, sizeof(in->group));
+	bzero(in->prior, sizeof(in->prior));
+	in->pending = 0;
+	in->applied = 0;
 
 	in->next = next;
 	in->ctx = ctx;
@@ -70,11 +194,158 @@ static void integrator_init(struct integrator *in, double lb, double ub, double
 	in->window[1] = find_lb(in, in->bounds[0]);
 }
 
-static struct result *integrator_next(struct integrator *in, double *ts) {
-	static struct result rout = { 0 };
+// MARK: Higher order
+
+// The sample as the integrand sees it
+static struct datum through(const struct integrator *in, struct datum d) {
+	if (in->ucty != NULL) {
+		d.value = in->ucty(d.value).value;
+	}
+
+	return d;
+}
+
+// x^2 coefficient of the parabola through a, b and c. Against that
+// parabola, a trapezoid of width h is off by -curvature * h^3 / 6.
+static double curvature(struct datum a, struct datum b, struct datum c) {
+	double h0 = b.timestamp - a.timestamp, h1 = c.timestamp - b.timestamp;
+
+	if (!(h0 > 0 && h1 > 0)) {
+		return 0;
+	}
+
+	return ((a.value - b.value) * h1 + (c.value - b.value) * h0) / (h0 * h1 * (h0 + h1));
+}
+
+static double trapezoid(struct datum a, struct datum b) {
+	return (b.timestamp - a.timestamp) * (a.value + b.value) / 2;
+}
+
+// Simpson over [a, c], less the two trapezoids; any spacing
+static double simpson_correction(struct datum a, struct datum b, struct datum c) {
+	double h0 = b.timestamp - a.timestamp, h1 = c.timestamp - b.timestamp;
+
+	return -curvature(a, b, c) * (pow(h0, 3) + pow(h1, 3)) / 6;
+}
+
+// Simpson over two pairs, a to c and c to e, less Simpson over the
+// pair of them at twice the spacing. Richardson says a fifteenth of
+// that is how far off the finer one is.
+static double richardson(struct datum a, struct datum b, struct datum c, struct datum d, struct datum e) {
+	double fine = 0, coarse = 0;
+
+	fine = trapezoid(a, b) + trapezoid(b, c) + simpson_correction(a, b, c);
+	fine += trapezoid(c, d) + trapezoid(d, e) + simpson_correction(c, d, e);
+	coarse = trapezoid(a, c) + trapezoid(c, e) + simpson_correction(a, c, e);
+
+	return (fine - coarse) / 15;
+}
+
+// Whether a to e is smooth enough for Simpson to help: both pairs'
+// parabolas should bend about the same way. Across a corner (takeoff,
+// landing, anywhere the plate saturates) one of them is fitting a
+// kink, its curvature is off by the change in slope over h, and plain
+// trapezoids do better. Richardson's no use for telling; it's second
+// order there too, and about as often says all's well.
+//
+// Through an inflection neither bends much and their curvatures can
+// be any which way, so there it's enough that they don't bend apart
+// by much next to how steep a to e is. A kink bends apart by its whole
+// change in slope, which is about as steep as it gets.
+static int smooth(struct datum a, struct datum b, struct datum c, struct datum d, struct datum e) {
+	double c0 = curvature(a, b, c), c1 = curvature(c, d, e);
+	double span = e.timestamp - a.timestamp;
+
+	if (fabs(c0 - c1) <= fabs(c0 + c1) / 2) {
+		return 1;
+	}
+
+	return span > 0 && fabs(c0 - c1) * span <= fabs(e.value - a.value) / span / 4;
+}
+
+// Composite Simpson over pairs of steps, returned as a correction to
+// each second step's trapezoid, with an error estimate per group of
+// four steps. Until a group is done, what's there gets a provisional
+// estimate, which comes back out once it is; so summed over steps,
+// *err is always the estimated error of the running total. It's
+// signed: truncation error from smooth curvature adds up, while
+// estimates driven by sample noise mostly cancel.
+//
+// A group with a corner in it stays trapezoids, and is off by about
+// what Simpson would have corrected. The correction itself is
+// provisional too: the first pair goes by the one before it, and the
+// group's end settles it either way.
+static double simpson_step(struct integrator *in, double *err) {
+	struct datum *p = in->group, *q = in->prior;
+	int k = in->steps % 4;
+	double corr = 0, pending = 0, whole = 0;
+
+	if (k == 0) {
+		p[0] = through(in, in->window[0]);
+	}
+	p[k + 1] = through(in, in->window[1]);
+
+	switch (k) {
+		case 0:
+			// Half a pair is just a trapezoid, off by about its
+			// share of the parabola through the last three points
+			if (in->steps > 0) {
+				pending = -curvature(q[1], p[0], p[1]) * pow(p[1].timestamp - p[0].timestamp, 3) / 6;
+			}
+			break;
+		case 1:
+			// A whole pair: half of what the last two pairs are
+			// off by, or if it's the first, the trapezoids' error
+			// (which is plenty). If it doesn't bend like the pair
+			// before it, trapezoids until the group says otherwise.
+			corr = simpson_correction(p[0], p[1], p[2]);
+			if (in->steps <= 4) {
+				pending = corr;
+			} else if (smooth(q[0], q[1], p[0], p[1], p[2])) {
+				pending = richardson(q[0], q[1], p[0], p[1], p[2]) / 2;
+			} else {
+				pending = -corr;
+				corr = 0;
+			}
+
+			in->applied = corr;
+			break;
+		case 2:
+			pending = in->pending - curvature(p[1], p[2], p[3]) * pow(p[3].timestamp - p[2].timestamp, 3) / 6;
+			break;
+		case 3:
+			whole = simpson_correction(p[0], p[1], p[2]) + simpson_correction(p[2], p[3], p[4]);
+			if (smooth(p[0], p[1], p[2], p[3], p[4])) {
+				corr = whole - in->applied;
+				pending = richardson(p[0], p[1], p[2], p[3], p[4]);
+			} else {
+				corr = -in->applied;
+				pending = -whole;
+			}
+
+			// Group's done, and that's final
+			*err = pending - in->pending;
+			in->pending = 0;
+			q[0] = p[2];
+			q[1] = p[3];
+			return corr;
+		default:
+			assert(0);
+	}
+
+	*err = pending - in->pending;
+	in->pending = pending;
+	return corr;
+}
+
+// MARK: Stepping
+
+static struct dual *integrator_next(struct integrator *in, double *ts) {
+	static struct dual rout = { 0 };
 	struct datum *cur = NULL;
 
 	assert_integrator_valid(in);
+	bzero(&rout, sizeof(rout));
 
 	// Apply the initial condition
 	rout.value = in->icond;
@@ -85,7 +356,6 @@ static struct result *integrator_next(struct integrator *in, double *ts) {
 	cur = in->next(in);
 
 	if (cur == NULL || cur->timestamp > in->bounds[1]) {
-		csv_stopiter();
 		return NULL;
 	}
 
@@ -93,61 +363,255 @@ static struct result *integrator_next(struct integrator *in, double *ts) {
 	{
 		in->window[1] = *cur;
 		double average = (in->window[0].value + in->window[1].value) / 2;
-		rout.value += (in->window[1].timestamp - in->window[0].timestamp) * average;
+		double dt = in->window[1].timestamp - in->window[0].timestamp;
+		struct dual f = dual_const(average);
 
 		if (in->ucty != NULL) {
-			rout.ucty = intdt_ucty_term(in->window[0], in->window[1], in->ucty(average));
+			f = in->ucty(average);
 		}
+
+		rout.value += dt * f.value;
+		in->running += dt * f.value;
+
+		// ...and polish off uncertainty.
+		for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+			if (ucty_per_sample[i] != 0) {
+				rout.d[i] = intdt_ucty_term(in->window[0], in->window[1], f.d[i]);
+			} else {
+				rout.d[i] = dt * f.d[i];
+			}
+		}
+
+		if (in->rule == QUAD_SIMPSON) {
+			double corr = simpson_step(in, &rout.d[UCTY_QUADRATURE]);
+
+			rout.value += corr;
+			in->running += corr;
+		}
+
+		if (in->steps++ == 0) {
+			in->edges[0] = f.value;
+		}
+		in->edges[1] = f.value;
 	}
 
-	// ...and polish off uncertainty.
 	if (ts != NULL) {
 		*ts = (in->window[1].timestamp + in->window[0].timestamp) / 2;
 	}
 	return &rout;
 }
 
-static struct result do_integration(struct integrator *in) {
-	struct result r = { 0 };
-	double sq_ucty_rsum = 0;
+static struct dual do_integration(struct integrator *in) {
+	struct dual r = { 0 };
+	double sq_ucty_rsum[NUM_UCTY_SRCS] = { 0 };
 
 	assert_integrator_valid(in);
 
-	for (int i = 0; i < MAX_DATUMS; i++) {
-		struct result *int_r = integrator_next(in, NULL);
+	for (int i = 0; i < MAX_SAMPLES; i++) {
+		struct dual *int_r = integrator_next(in, NULL);
 
 		if (int_r == NULL) {
-			r.ucty = sqrt(sq_ucty_rsum);
+			for (int j = 0; j < NUM_UCTY_SRCS; j++) {
+				if (ucty_per_sample[j] != 0) {
+					r.d[j] = sqrt(sq_ucty_rsum[j]);
+				}
+			}
 			return r;
 		}
 
 		r.value += int_r->value;
-		sq_ucty_rsum += pow(int_r->ucty, 2);
+		for (int j = 0; j < NUM_UCTY_SRCS; j++) {
+			if (ucty_per_sample[j] != 0) {
+				sq_ucty_rsum[j] += pow(int_r->d[j], 2);
+			} else {
+				r.d[j] += int_r->d[j];
+			}
+		}
 	}
 
 	// Should not be reached
-	errx(1, "huge csv");
+	bf_errx(BF_ELIMIT, -1, "huge csv");
 }
 
 // MARK: Functions
 
-static struct datum *intdt_next(struct integrator *in) {
-	struct desc d = { 0 };
+struct column_cursor {
+	const struct column *c;
+	size_t i;
+};
+
+static struct datum *column_next(struct integrator *in) {
+	static struct datum dout = { 0 };
+	struct column_cursor *cc = NULL;
+
 	assert_integrator_valid(in);
+	cc = (struct column_cursor *)in->ctx;
+	assert(cc->c != NULL);
 
-	d = *(struct desc *)in->ctx;
-	assert_desc_valid(d);
-	return csv_iterate(d);
+	if (cc->i >= cc->c->n) {
+		return NULL;
+	}
+
+	// Packed columns get widened here, a sample at a time
+	dout.timestamp = column_ts(cc->c, cc->i);
+	dout.value = column_v(cc->c, cc->i);
+	cc->i++;
+	return &dout;
+}
+
+struct frame_cursor {
+	const struct frame *f;
+	int ch;
+	size_t i;
+};
+
+static struct datum *frame_next(struct integrator *in) {
+	static struct datum dout = { 0 };
+	struct frame_cursor *fc = NULL;
+
+	assert_integrator_valid(in);
+	fc = (struct frame_cursor *)in->ctx;
+	assert(fc->ch >= 0 && fc->ch < fc->f->nch);
+
+	if (fc->i >= fc->f->n) {
+		return NULL;
+	}
+
+	dout.timestamp = frame_ts(fc->f, fc->i);
+	dout.value = fc->f->v[fc->i * (size_t)fc->f->nch + (size_t)fc->ch];
+	fc->i++;
+	return &dout;
+}
+
+// What intdt would give for a bound that the steps so far just reach
+static struct dual sweep_point(const struct dual *r, const double *sq_ucty_rsum, const double *edges, struct dual lb, struct dual ub) {
+	struct dual p = *r;
+
+	for (int i = 0; i < NUM_UCTY_SRCS; i++) {
+		if (ucty_per_sample[i] != 0) {
+			p.d[i] = sqrt(sq_ucty_rsum[i]);
+		}
+
+		// Moving a bound moves the integral by the integrand at that
+		// bound, so uncertain bounds (takeoff!) carry through here.
+		p.d[i] += edges[1] * ub.d[i] - edges[0] * lb.d[i];
+	}
+
+	return p;
+}
+
+// Bounds in a sweep are ub + offset, which rounds; 1.007 + 0.001 comes
+// out a hair short of a sample at 1.008. Unshifted bounds stay exact.
+#define SWEEP_SLOP 1e-9
+
+static double sweep_bound(struct dual ub, double offset) {
+	return offset == 0 ? ub.value : ub.value + offset + SWEEP_SLOP;
 }
 
-struct result math_intdt(struct desc d, double lb, double ub, uctyf ucty) {
+// The integral up to ub + offsets[k], for every k, in one pass: each
+// grid point gets the running total as of the last step that fits
+// under it. offsets must be ascending. Bounds at or before lb get 0.
+static void intdt_sweep(void *ctx, nf next, struct dual lb, struct dual ub, const double *offsets, int n, uctyf ucty, int rule, struct dual *out) {
 	struct integrator in = { 0 };
+	struct dual r = { 0 };
+	double sq_ucty_rsum[NUM_UCTY_SRCS] = { 0 };
+	int k = 0;
 
-	assert_desc_valid(d);
-	integrator_init(&in, lb, ub, 0, &d, &intdt_next, ucty);
+	assert(offsets != NULL && out != NULL);
+	assert(n > 0);
+
+	for (int i = 1; i < n; i++) {
+		assert(offsets[i] > offsets[i - 1]);
+	}
+
+	for (; k < n && sweep_bound(ub, offsets[k]) <= lb.value; k++) {
+		out[k] = dual_const(0);
+	}
+
+	if (k == n) {
+		return;
+	}
+
+	integrator_init(&in, lb.value, sweep_bound(ub, offsets[n - 1]), 0, ctx, next, ucty, rule);
 	assert_integrator_valid(&in);
 
-	return do_integration(&in);
+	for (int i = 0; i < MAX_SAMPLES && k < n; i++) {
+		double edges[2] = { in.edges[0], in.edges[1] };
+		struct dual *int_r = integrator_next(&in, NULL);
+
+		// 1. Whoever this step overshoots is done
+		while (k < n && (int_r == NULL || in.window[1].timestamp > sweep_bound(ub, offsets[k]))) {
+			out[k++] = sweep_point(&r, sq_ucty_rsum, edges, lb, ub);
+		}
+
+		if (int_r == NULL) {
+			break;
+		}
+
+		// 2. Everyone else gets this step
+		r.value += int_r->value;
+		for (int j = 0; j < NUM_UCTY_SRCS; j++) {
+			if (ucty_per_sample[j] != 0) {
+				sq_ucty_rsum[j] += pow(int_r->d[j], 2);
+			} else {
+				r.d[j] += int_r->d[j];
+			}
+		}
+	}
+
+	if (k < n) {
+		bf_errx(BF_ELIMIT, -1, "huge csv");
+	}
+}
+
+static struct dual intdt(void *ctx, nf next, struct dual lb, struct dual ub, uctyf ucty, int rule) {
+	const double here = 0;
+	struct dual r = { 0 };
+
+	check_bounds(lb.value, ub.value);
+	intdt_sweep(ctx, next, lb, ub, &here, 1, ucty, rule, &r);
+	return r;
+}
+
+// Integrates the column as filtered (see sig_column)
+struct dual math_intdt(struct desc d, struct dual lb, struct dual ub, uctyf ucty, int rule) {
+	struct column_cursor cc = { 0 };
+
+	assert_desc_valid(d);
+	cc.c = sig_column(d);
+	return intdt(&cc, &column_next, lb, ub, ucty, rule);
+}
+
+struct dual math_intdt_frame(const struct frame *f, int ch, struct dual lb, struct dual ub, uctyf ucty, int rule) {
+	struct frame_cursor fc = {
+		.f = f,
+		.ch = ch,
+		.i = 0,
+	};
+
+	assert(f != NULL);
+	assert(ch >= 0 && ch < f->nch);
+	return intdt(&fc, &frame_next, lb, ub, ucty, rule);
+}
+
+void math_intdt_sweep(struct desc d, struct dual lb, struct dual ub, const double *offsets, int n, uctyf ucty, int rule, struct dual *out) {
+	struct column_cursor cc = { 0 };
+
+	assert_desc_valid(d);
+	cc.c = sig_column(d);
+	intdt_sweep(&cc, &column_next, lb, ub, offsets, n, ucty, rule, out);
+}
+
+void math_intdt_frame_sweep(const struct frame *f, int ch, struct dual lb, struct dual ub, const double *offsets, int n, uctyf ucty, int rule, struct dual *out) {
+	struct frame_cursor fc = {
+		.f = f,
+		.ch = ch,
+		.i = 0,
+	};
+
+	assert(f != NULL);
+	assert(ch >= 0 && ch < f->nch);
+	intdt_sweep(&fc, &frame_next, lb, ub, offsets, n, ucty, rule, out);
 }
 
 // MARK: Double integration
@@ -160,31 +624,37 @@ static struct datum *dintdt_next(struct integrator *in) {
 	static struct datum dout = { 0 };
 
 	struct integrator *nested = NULL;
-	struct result *nres = NULL;
+	struct dual *nres = NULL;
 	double nts = 0;
 
 	assert_integrator_valid(in);
 	nested = (struct integrator *)in->ctx;
 	assert_integrator_valid(nested);
 
+	// The outer integral wants the running total (velocity),
+	// not this step's slice of it.
 	nres = integrator_next(nested, &nts);
 	if (nres == NULL) {
 		return NULL;
 	} else {
 		dout.timestamp = nts;
-		dout.value = nres->value;
+		dout.value = nested->icond + nested->running;
 		return &dout;
 	}
 }
 
-static double math_dintdt(struct desc d, double lb, double ub, double icond) {
+static double math_dintdt(const struct column *c, double lb, double ub, double icond, int rule) {
 	struct integrator outer = { 0 }, inner = { 0 };
+	struct column_cursor cc = {
+		.c = c,
+		.i = 0,
+	};
 
-	assert_desc_valid(d);
-	integrator_init(&inner, lb, ub, icond, &d, &intdt_next, NULL);
+	assert(c != NULL);
+	integrator_init(&inner, lb, ub, icond, &cc, &column_next, NULL, rule);
 	assert_integrator_valid(&inner);
 
-	integrator_init(&outer, lb, ub, 0, &inner, &dintdt_next, NULL);
+	integrator_init(&outer, lb, ub, 0, &inner, &dintdt_next, NULL, rule);
 	assert_integrator_valid(&outer);
 
 	return do_integration(&outer).value;
@@ -202,19 +672,20 @@ static void debug_log(int debug, const char *msg, ...) {
 	va_end(ap);
 }
 
-double math_dintdt_bestcond(struct desc d, double lb, double ub) {
+double math_dintdt_bestcond(struct desc d, double lb, double ub, int rule) {
 	// Find the best initial condition we can find
 	double min = -MAX_INITIAL_CONDITION, max = MAX_INITIAL_CONDITION;
 	int dbg = getenv("PHYSICS_DEBUG_DINTDT") != NULL;
+	const struct column *c = NULL;
 
 	assert_desc_valid(d);
-	assert(lb >= 0 && ub > 0);
-	assert(ub > lb);
+	c = sig_column(d);
+	check_bounds(lb, ub);
 
 	debug_log(dbg, "start (%f - %f)", lb, ub);
 	for (int i = 0; i < 100; i++) {
 		double icond = (max + min) / 2;
-		double result = math_dintdt(d, lb, ub, icond);
+		double result = math_dintdt(c, lb, ub, icond, rule);
 
 		if (fabs(result) < EPSILON) {
 			debug_log(dbg, "DONE: %f err %f took %d iterations", icond, result, i);
@@ -230,27 +701,31 @@ double math_dintdt_bestcond(struct desc d, double lb, double ub) {
 		}
 	}
 
-	errx(1, "search failed; best bounds %f-%f", min, max);
+	bf_errx(BF_EDATA, -1, "search failed; best bounds %f-%f", min, max);
 }
 
-struct datum math_dintdt_min(struct desc d, double lb, double ub) {
+// Lowest point of the double integral, under the initial condition that
+// brings it back to zero at ub. If traj is given, it gets the whole
+// velocity/displacement trajectory along the way, one call per step.
+struct datum math_dintdt_min(struct desc d, double lb, double ub, int rule, trajf traj, void *ctx) {
 	struct datum finding = { 0 };
 	struct integrator outer = { 0 }, inner = { 0 };
+	struct column_cursor cc = { 0 };
 
 	assert_desc_valid(d);
-	assert(lb >= 0 && ub > 0);
-	assert(ub > lb);
+	check_bounds(lb, ub);
 
 	// 1. Find the optimal initial condition
 	{
 		double bestcond = 0;
 
-		bestcond = math_dintdt_bestcond(d, lb, ub);
+		bestcond = math_dintdt_bestcond(d, lb, ub, rule);
+		cc.c = sig_column(d);
 
-		integrator_init(&inner, lb, ub, bestcond, &d, &intdt_next, NULL);
+		integrator_init(&inner, lb, ub, bestcond, &cc, &column_next, NULL, rule);
 		assert_integrator_valid(&inner);
 
-		integrator_init(&outer, lb, ub, 0, &inner, &dintdt_next, NULL);
+		integrator_init(&outer, lb, ub, 0, &inner, &dintdt_next, NULL, rule);
 		assert_integrator_valid(&outer);
 	}
 
@@ -258,22 +733,251 @@ struct datum math_dintdt_min(struct desc d, double lb, double ub) {
 	finding.value = HUGE_VAL;
 	finding.timestamp = -1;
 
-	for (int i = 0; i < MAX_DATUMS; i++) {
-		double ts = 0;
-		struct result *int_r = integrator_next(&outer, &ts);
+	for (int i = 0; i < MAX_SAMPLES; i++) {
+		struct datum vel = { 0 };
 
-		if (int_r == NULL) {
-			assert(finding.timestamp > -1);
+		if (integrator_next(&outer, NULL) == NULL) {
+			if (finding.timestamp < 0) {
+				bf_errx(BF_EDATA, -1, "nothing to integrate in %f-%f", lb, ub);
+			}
 			return finding;
 		}
 
-		if (int_r->value < finding.value) {
-			finding.timestamp = ts;
-			finding.value = int_r->value;
+		// Velocity sample we just stepped to, and where that left us
+		vel = outer.window[1];
+		if (traj != NULL) {
+			traj(vel.timestamp, vel.value, outer.running, ctx);
+		}
+
+		if (outer.running < finding.value) {
+			finding.timestamp = vel.timestamp;
+			finding.value = outer.running;
 		}
 	}
 
 	// Should not be reached
-	errx(1, "huge csv");
+	bf_errx(BF_ELIMIT, -1, "huge csv");
+}
+
+
+// MARK: Rolling windows
+
+// Everything from the first sample up to sample i, kept as running
+// sums, so a window's share is just the difference of two of them no
+// matter how wide it is. Partials from per-sample sources go in squared.
+static double roll_ts[MAX_SAMPLES] = { 0 };
+static double roll_v[MAX_SAMPLES] = { 0 };
+static double roll_int[MAX_SAMPLES] = { 0 };
+static double roll_inner[MAX_SAMPLES] = { 0 };		// integral of roll_int
+static double roll_d[MAX_SAMPLES][NUM_UCTY_SRCS] = { 0 };
+static double roll_noise[MAX_SAMPLES][3] = { 0 };
+
+// Monotonic deques of sample indices: values only ever fall from the
+// head of maxq back, and rise in minq. Every sample goes in and comes
+// out at most once, and nothing wraps, since there are never more than
+// MAX_SAMPLES of them.
+struct roll_deque {
+	size_t q[MAX_SAMPLES];
+	size_t head;
+	size_t tail;
+};
+
+static struct roll_deque maxq = { 0 }, minq = { 0 };
+
+// Window edges are start + k * step + width, which rounds like sweeps do
+#define ROLL_SLOP 1e-9
+
+static void deque_push(struct roll_deque *dq, size_t i, int sign) {
+	while (dq->tail > dq->head && sign * roll_v[dq->q[dq->tail - 1]] <= sign * roll_v[i]) {
+		dq->tail--;
+	}
+
+	assert(dq->tail < MAX_SAMPLES);
+	dq->q[dq->tail++] = i;
+}
+
+static double deque_front(struct roll_deque *dq, size_t lo) {
+	while (dq->q[dq->head] < lo) {
+		dq->head++;
+	}
+
+	assert(dq->head < dq->tail);
+	return roll_v[dq->q[dq->head]];
 }
 
+// Sample n, and the step that got us there from n - 1
+static void roll_push(size_t n, struct datum s, const struct dual *step) {
+	roll_ts[n] = s.timestamp;
+	roll_v[n] = s.value;
+
+	if (n == 0) {
+		roll_int[0] = roll_inner[0] = 0;
+		bzero(roll_d[0], sizeof(roll_d[0]));
+		bzero(roll_noise[0], sizeof(roll_noise[0]));
+	} else {
+		double dt = roll_ts[n] - roll_ts[n - 1];
+		double tau = (roll_ts[n] + roll_ts[n - 1]) / 2;
+		double w = 0;
+
+		roll_int[n] = roll_int[n - 1] + step->value;
+		roll_inner[n] = roll_inner[n - 1] + (roll_int[n - 1] + roll_int[n]) / 2 * dt;
+
+		for (int j = 0; j < NUM_UCTY_SRCS; j++) {
+			if (ucty_per_sample[j] != 0) {
+				roll_d[n][j] = roll_d[n - 1][j] + pow(step->d[j], 2);
+				w += pow(step->d[j], 2);
+			} else {
+				roll_d[n][j] = roll_d[n - 1][j] + step->d[j];
+			}
+		}
+
+		roll_noise[n][0] = roll_noise[n - 1][0] + w;
+		roll_noise[n][1] = roll_noise[n - 1][1] + w * tau;
+		roll_noise[n][2] = roll_noise[n - 1][2] + w * tau * tau;
+	}
+
+	deque_push(&maxq, n, 1);
+	deque_push(&minq, n, -1);
+}
+
+static void roll_emit(size_t lo, size_t hi, windowf emit, void *ctx) {
+	struct roll_window w = { 0 };
+
+	assert(lo < hi);
+
+	w.lb = roll_ts[lo];
+	w.ub = roll_ts[hi];
+
+	w.integral.value = roll_int[hi] - roll_int[lo];
+	for (int j = 0; j < NUM_UCTY_SRCS; j++) {
+		double diff = roll_d[hi][j] - roll_d[lo][j];
+
+		w.integral.d[j] = ucty_per_sample[j] != 0 ? sqrt(fmax(diff, 0)) : diff;
+	}
+
+	// Whatever had piled up by lb doesn't count
+	w.inner = roll_inner[hi] - roll_inner[lo] - roll_int[lo] * (w.ub - w.lb);
+	for (int k = 0; k < 3; k++) {
+		w.noise[k] = roll_noise[hi][k] - roll_noise[lo][k];
+	}
+
+	w.max = deque_front(&maxq, lo);
+	w.min = deque_front(&minq, lo);
+	emit(&w, ctx);
+}
+
+// Windows width long, one every step from the first sample at or after
+// lb, for as long as they fit under ub and the data. Each one spans the
+// samples inside it, same as math_intdt over those bounds would, and
+// windows with fewer than two samples get skipped. It's all one pass of
+// the integrator: a window goes out as soon as a sample lands past it.
+//
+// Always trapezoids; Simpson's groups of four don't stop at window edges.
+void math_roll(struct desc d, double lb, double ub, double width, double step, uctyf ucty, windowf emit, void *ctx) {
+	struct integrator in = { 0 };
+	struct column_cursor cc = { 0 };
+	double start = 0;
+	size_t n = 0, lo = 0;
+	long k = 0;
+
+	assert_desc_valid(d);
+	check_bounds(lb, ub);
+	assert(width > 0 && step > 0);
+	assert(emit != NULL);
+
+	cc.c = sig_column(d);
+	integrator_init(&in, lb, ub, 0, &cc, &column_next, ucty, QUAD_TRAPEZOID);
+	assert_integrator_valid(&in);
+
+	maxq.head = maxq.tail = 0;
+	minq.head = minq.tail = 0;
+
+	roll_push(n++, in.window[1], NULL);
+	start = in.window[1].timestamp;
+
+	for (;;) {
+		struct dual *int_r = integrator_next(&in, NULL);
+		double next = int_r != NULL ? in.window[1].timestamp : roll_ts[n - 1] + 2 * ROLL_SLOP;
+
+		// 1. Every window that ends short of the new sample is complete
+		for (double a = start + (double)k * step; a + width + ROLL_SLOP < next; a = start + (double)++k * step) {
+			while (lo < n - 1 && roll_ts[lo] < a - ROLL_SLOP) {
+				lo++;
+			}
+
+			if (lo < n - 1) {
+				roll_emit(lo, n - 1, emit, ctx);
+			}
+		}
+
+		if (int_r == NULL) {
+			return;
+		} else if (n == MAX_SAMPLES) {
+			bf_errx(BF_ELIMIT, -1, "huge csv");
+		}
+
+		// 2. Then it can go in, if it's actually later
+		if (!(in.window[1].timestamp > roll_ts[n - 1])) {
+			bf_errx(BF_EDATA, -1, "time doesn't advance at %f s in %s for run %d", in.window[1].timestamp, d.field, d.run);
+		}
+		roll_push(n++, in.window[1], int_r);
+	}
+}
+
+// MARK: Running statistics
+
+void moments_add(struct moments *m, double x, double y) {
+	double dx = 0, dy = 0;
+
+	assert(m != NULL && m->n >= 0);
+
+	m->n++;
+	dx = x - m->mx;
+	dy = y - m->my;
+	m->mx += dx / (double)m->n;
+	m->my += dy / (double)m->n;
+
+	// Old deviation times new one, per Welford
+	m->m2x += dx * (x - m->mx);
+	m->m2y += dy * (y - m->my);
+	m->cxy += dx * (y - m->my);
+}
+
+void moments_merge(struct moments *into, const struct moments *from) {
+	double na = 0, nb = 0, n = 0, dx = 0, dy = 0;
+
+	assert(into != NULL && from != NULL);
+
+	if (from->n == 0) {
+		return;
+	} else if (into->n == 0) {
+		*into = *from;
+		return;
+	}
+
+	na = (double)into->n;
+	nb = (double)from->n;
+	n = na + nb;
+	dx = from->mx - into->mx;
+	dy = from->my - into->my;
+
+	// Chan et al.'s pairwise update; the co-moment merges the same way
+	into->m2x += from->m2x + dx * dx * na * nb / n;
+	into->m2y += from->m2y + dy * dy * na * nb / n;
+	into->cxy += from->cxy + dx * dy * na * nb / n;
+	into->mx += dx * nb / n;
+	into->my += dy * nb / n;
+	into->n += from->n;
+}
+
+// Sample variance of y
+double moments_var(const struct moments *m) {
+	assert(m != NULL);
+	return m->n > 1 ? m->m2y / (double)(m->n - 1) : 0;
+}
+
+// dy/dx, or 0 if x never moved
+double moments_slope(const struct moments *m) {
+	assert(m != NULL);
+	return m->m2x > 0 ? m->cxy / m->m2x : 0;
+}
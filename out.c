@@ -0,0 +1,284 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "physics.h"
+
+// Structured results, one record per run and metric, for pipelines
+// that would otherwise be scraping the text output.
+//
+// Records get assembled by hand into one big buffer that goes out
+// with write(2) when it fills up, so there's no stdio underneath.
+// Strings and integers are copied in directly; only doubles go
+// through snprintf(3), since getting them back bit for bit is its
+// job, not ours. Nothing else goes to stdout in these modes; the
+// banner and friends are for humans.
+
+#define OUT_BUFSIZ (1024 * 1024)
+
+// Significant digits to try in JSON. 17 always gets a double back
+// exactly, and shorter usually does.
+#define OUT_DIGITS_MIN 15
+#define OUT_DIGITS_MAX 17
+#define OUT_DOUBLE_MAX 32
+
+static char buf[OUT_BUFSIZ] = { 0 };
+static size_t used = 0;
+static int format = OUT_TEXT;
+
+// MARK: Buffering
+
+void out_flush(void) {
+	size_t off = 0;
+
+	while (off < used) {
+		ssize_t w = write(STDOUT_FILENO, buf + off, used - off);
+
+		if (w < 0 && errno == EINTR) {
+			continue;
+		} else if (w <= 0) {
+			err(1, "write stdout");
+		}
+
+		off += (size_t)w;
+	}
+
+	used = 0;
+}
+
+// Room for n more bytes
+static char *reserve(size_t n) {
+	assert(n <= sizeof(buf));
+
+	if (used + n > sizeof(buf)) {
+		out_flush();
+	}
+
+	return buf + used;
+}
+
+// MARK: Formatting
+
+static char *put_str(char *p, const char *s) {
+	size_t l = strlen(s);
+
+	memcpy(p, s, l);
+	return p + l;
+}
+
+static char *put_uint(char *p, uint64_t u) {
+	char digits[20] = { 0 };
+	int n = 0;
+
+	do {
+		digits[n++] = (char)('0' + u % 10);
+		u /= 10;
+	} while (u > 0);
+
+	while (n > 0) {
+		*p++ = digits[--n];
+	}
+
+	return p;
+}
+
+static char *put_int(char *p, int64_t i) {
+	if (i < 0) {
+		*p++ = '-';
+		return put_uint(p, (uint64_t)(-(i + 1)) + 1);
+	}
+
+	return put_uint(p, (uint64_t)i);
+}
+
+// The fewest digits that read back as the same double, so a reader
+// gets exactly what the binary records would have had. JSON has no
+// NaN, so null.
+static char *put_double(char *p, double d) {
+	int l = 0;
+
+	if (!isfinite(d)) {
+		return put_str(p, "null");
+	}
+
+	for (int digits = OUT_DIGITS_MIN; digits <= OUT_DIGITS_MAX; digits++) {
+		l = snprintf(p, OUT_DOUBLE_MAX, "%.*g", digits, d);
+		if (strtod(p, NULL) == d) {
+			break;
+		}
+	}
+
+	assert(l > 0 && l < OUT_DOUBLE_MAX);
+	return p + l;
+}
+
+// MARK: Records
+
+int out_parse_format(const char *s) {
+	assert(s != NULL);
+
+	if (strcmp(s, "text") == 0) {
+		return OUT_TEXT;
+	} else if (strcmp(s, "jsonl") == 0) {
+		return OUT_JSONL;
+	} else if (strcmp(s, "bin") == 0) {
+		return OUT_BINARY;
+	}
+
+	return -1;
+}
+
+void out_set_format(int f) {
+	assert(f == OUT_TEXT || f == OUT_JSONL || f == OUT_BINARY);
+	format = f;
+}
+
+int out_format(void) {
+	return format;
+}
+
+// {"run":N,"kind":"...","metric":"..."
+static char *put_head(char *p, int run, int flip, const struct metric *mt) {
+	p = put_str(p, "{\"run\":");
+	p = put_int(p, run);
+	p = put_str(p, flip ? ",\"kind\":\"flip\"" : ",\"kind\":\"jump\"");
+	p = put_str(p, ",\"metric\":\"");
+	p = put_str(p, mt->key);
+	return put_str(p, "\"");
+}
+
+// ,"value":...,"ucty":...,"units":"..."}
+static char *put_tail(char *p, const struct metric *mt, struct result r) {
+	p = put_str(p, ",\"value\":");
+	p = put_double(p, r.value);
+	p = put_str(p, ",\"ucty\":");
+	p = put_double(p, r.ucty);
+	p = put_str(p, ",\"units\":\"");
+	p = put_str(p, mt->units);
+	return put_str(p, "\"}\n");
+}
+
+void out_metric(int run, int flip, int metric, struct result r) {
+	const struct metric *mt = phy_metric(metric);
+	char *p = NULL, *start = NULL;
+
+	assert(format != OUT_TEXT);
+
+	if (format == OUT_BINARY) {
+		struct out_record rec = {
+			.run = run,
+			.metric = (int16_t)metric,
+			.flip = (int16_t)(flip != 0),
+			.value = r.value,
+			.ucty = r.ucty,
+		};
+
+		memcpy(reserve(sizeof(rec)), &rec, sizeof(rec));
+		used += sizeof(rec);
+		return;
+	}
+
+	// Generous: names and units are short, numbers are < 32 bytes each
+	start = p = reserve(256);
+	p = put_head(p, run, flip, mt);
+	p = put_tail(p, mt, r);
+
+	assert(p - start <= 256);
+	used += (size_t)(p - start);
+}
+
+void out_sweep(int run, int flip, int metric, double offset, double ub, struct result r) {
+	const struct metric *mt = phy_metric(metric);
+	char *p = NULL, *start = NULL;
+
+	assert(format != OUT_TEXT);
+
+	if (format == OUT_BINARY) {
+		struct out_sweep_record rec = {
+			.run = run,
+			.metric = (int16_t)metric,
+			.flip = (int16_t)(flip != 0),
+			.offset = offset,
+			.ub = ub,
+			.value = r.value,
+			.ucty = r.ucty,
+		};
+
+		memcpy(reserve(sizeof(rec)), &rec, sizeof(rec));
+		used += sizeof(rec);
+		return;
+	}
+
+	start = p = reserve(320);
+	p = put_head(p, run, flip, mt);
+	p = put_str(p, ",\"offset\":");
+	p = put_double(p, offset);
+	p = put_str(p, ",\"ub\":");
+	p = put_double(p, ub);
+	p = put_tail(p, mt, r);
+
+	assert(p - start <= 320);
+	used += (size_t)(p - start);
+}
+
+// ,"key":...,"key_ucty":...
+static char *put_pair(char *p, const char *key, struct result r) {
+	p = put_str(p, ",\"");
+	p = put_str(p, key);
+	p = put_str(p, "\":");
+	p = put_double(p, r.value);
+	p = put_str(p, ",\"");
+	p = put_str(p, key);
+	p = put_str(p, "_ucty\":");
+	return put_double(p, r.ucty);
+}
+
+void out_roll(int run, int flip, const struct roll_metrics *m) {
+	char *p = NULL, *start = NULL;
+
+	assert(format != OUT_TEXT);
+	assert(m != NULL);
+
+	if (format == OUT_BINARY) {
+		struct out_roll_record rec = {
+			.run = run,
+			.flip = (int16_t)(flip != 0),
+			.lb = m->lb,
+			.ub = m->ub,
+			.impulse = m->impulse.value,
+			.impulse_ucty = m->impulse.ucty,
+			.peak = m->peak.value,
+			.peak_ucty = m->peak.ucty,
+			.low = m->low.value,
+			.low_ucty = m->low.ucty,
+			.power = m->power.value,
+			.power_ucty = m->power.ucty,
+		};
+
+		memcpy(reserve(sizeof(rec)), &rec, sizeof(rec));
+		used += sizeof(rec);
+		return;
+	}
+
+	// Ten numbers and their names
+	start = p = reserve(512);
+	p = put_str(p, "{\"run\":");
+	p = put_int(p, run);
+	p = put_str(p, flip ? ",\"kind\":\"flip\"" : ",\"kind\":\"jump\"");
+	p = put_str(p, ",\"lb\":");
+	p = put_double(p, m->lb);
+	p = put_str(p, ",\"ub\":");
+	p = put_double(p, m->ub);
+	p = put_pair(p, "impulse", m->impulse);
+	p = put_pair(p, "peak", m->peak);
+	p = put_pair(p, "low", m->low);
+	p = put_pair(p, "power", m->power);
+	p = put_str(p, "}\n");
+
+	assert(p - start <= 512);
+	used += (size_t)(p - start);
+}
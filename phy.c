@@ -1,29 +1,197 @@
 #include <sys/types.h>
 
-#include <err.h>
 #include <math.h>
+#include <strings.h>
 
 #include "physics.h"
 
 #define LITTLE_G 9.81
 #define UCTY_LITTLE_G 0.01
 
+static int events_src = EVENTS_HANGTIME;
+static int interp = INTERP_LINEAR;
+static int rule = QUAD_TRAPEZOID;
+
+// Integration bounds, if somebody wants something other than [0, takeoff]
+static int bounded = 0;
+static double bounds[2] = { 0 };
+
+// The IMU rides on the plate's timestamp column, but its samples don't
+// really line up with the plate's. Plate force and IMU acceleration are
+// the same motion, so their cross correlation says by how much.
+#define SYNC_MAX_LAG_S 0.5
+
+static const char *imu_fields[] = {
+	"Z-angular velocity(rad/s)",
+	"Z-axis acceleration(m/s2)",
+};
+
+static const struct sync imu_sync = {
+	.ref = "Force(N)",
+	.probe = "Z-axis acceleration(m/s2)",
+	.followers = imu_fields,
+	.nfollowers = 2,
+	.maxlag = SYNC_MAX_LAG_S,
+};
+
+static int synced = 0;
+
 // MARK: Utilities
-static double takeoff_time(int run) {
+
+// Exporter flags takeoff on the first airborne sample, so the true
+// instant is somewhere in the preceding sample period.
+static double sample_period(int run) {
+	struct datum *cur = NULL;
+	double t0 = 0;
+	struct desc d = {
+		.run = run,
+		.field = "Force(N)",
+	};
+
+	assert_desc_valid(d);
+
+	if (NULL == (cur = csv_iterate(d))) {
+		bf_errx(BF_EDATA, -1, "no samples for run %d", run);
+	}
+	t0 = cur->timestamp;
+
+	if (NULL == (cur = csv_iterate(d))) {
+		bf_errx(BF_EDATA, -1, "single sample for run %d", run);
+	}
+
+	csv_stopiter();
+	if (!(cur->timestamp > t0)) {
+		bf_errx(BF_EDATA, -1, "time goes backwards in run %d", run);
+	}
+	return cur->timestamp - t0;
+}
+
+// MARK: Settings
+
+void phy_set_events(int src) {
+	assert(src == EVENTS_HANGTIME || src == EVENTS_FORCE);
+	events_src = src;
+}
+
+void phy_set_interp(int i) {
+	assert(i == INTERP_LINEAR || i == INTERP_CUBIC);
+	interp = i;
+}
+
+void phy_set_rule(int r) {
+	assert(r == QUAD_TRAPEZOID || r == QUAD_SIMPSON);
+	rule = r;
+}
+
+void phy_set_bounds(const double *b) {
+	if (b == NULL) {
+		bounded = 0;
+		return;
+	}
+
+	assert(b[0] >= 0 && b[1] > b[0]);
+	bounded = 1;
+	bounds[0] = b[0];
+	bounds[1] = b[1];
+}
+
+void phy_set_sync(int sync) {
+	synced = sync != 0;
+	sig_set_sync(synced ? &imu_sync : NULL);
+}
+
+int phy_events(void) {
+	return events_src;
+}
+
+int phy_interp(void) {
+	return interp;
+}
+
+int phy_rule(void) {
+	return rule;
+}
+
+int phy_synced(void) {
+	return synced;
+}
+
+// Hex floats, so nothing gets rounded into looking the same
+int phy_fingerprint(char *buf, size_t len) {
+	struct filter f = { 0 };
+
+	assert(buf != NULL && len > 0);
+	sig_get_filter(&f);
+
+	return snprintf(buf, len, "v%d mass=%a,%a plate=%a com=%a,%a w=%a g=%a,%a events=%a,%a sync=%a "
+	    "src=%d interp=%d rule=%d synced=%d bounds=%d,%a,%a filter=%d,%a,%d,%d,%d packed=%d delim=%d",
+	    BF_VERSION, MASS_KG, MASS_UCTY_KG, (double)FORCEPLATE_UCTY_N, (double)COM_M, COM_UCTY_M,
+	    (double)W_UCTY_RADSPERSEC, LITTLE_G, UCTY_LITTLE_G, (double)EVENT_OFF_N, (double)EVENT_ON_N,
+	    SYNC_MAX_LAG_S, events_src, interp, rule, synced, bounded, bounded ? bounds[0] : 0,
+	    bounded ? bounds[1] : 0, f.kind, f.cutoff, f.taps, f.zerophase, f.decimate, csv_packed(), csv_delimiter());
+}
+
+// MARK: Events
+
+// Not every rig exports hang time, in which case
+// we go find the events in the force signal ourselves.
+static int force_events(int run) {
+	struct desc d = {
+		.run = run,
+		.field = "Hang Time(s)",
+	};
+
+	assert_desc_valid(d);
+	return events_src == EVENTS_FORCE || csv_has_column(d) == 0;
+}
+
+static void detect_events(int run, struct event *takeoff, struct event *landing) {
+	const struct column *c = NULL;
+	struct desc d = {
+		.run = run,
+		.field = "Force(N)",
+	};
+
+	assert_desc_valid(d);
+	c = csv_column(d);
+
+	if (sig_events(c, EVENT_OFF_N, EVENT_ON_N, takeoff, landing) != 0) {
+		bf_errx(BF_EDATA, -1, "no takeoff/landing in force for run %d", run);
+	}
+}
+
+static struct dual takeoff_time(int run) {
 	struct datum *takeoff = NULL;
+	double ts = 0;
 	struct desc d = {
 		.run = run,
 		.field = "Hang Time(s)",
 	};
 
 	assert_desc_valid(d);
+
+	if (force_events(run)) {
+		struct event up = { 0 }, down = { 0 };
+
+		// Noise on the plate slides the crossing by sigma / slope
+		detect_events(run, &up, &down);
+		return dual_source(up.timestamp, UCTY_TAKEOFF, FORCEPLATE_UCTY_N / fabs(up.slope));
+	}
+
 	takeoff = csv_iterate(d);
+	if (takeoff == NULL) {
+		bf_errx(BF_EDATA, -1, "no takeoff for run %d", run);
+	}
+
+	ts = takeoff->timestamp;
 	csv_stopiter();
 
-	return takeoff->timestamp;
+	// Uniform over one sample period
+	return dual_source(ts, UCTY_TAKEOFF, sample_period(run) / sqrt(12));
 }
 
 static struct datum *landing_datum(int run) {
+	static struct datum detected = { 0 };
 	struct datum *ht = 0;
 	struct desc d = {
 		.run = run,
@@ -32,18 +200,101 @@ static struct datum *landing_datum(int run) {
 
 	assert_desc_valid(d);
 
+	if (force_events(run)) {
+		struct event up = { 0 }, down = { 0 };
+
+		detect_events(run, &up, &down);
+		detected.timestamp = down.timestamp;
+		detected.value = down.timestamp - up.timestamp;
+		return &detected;
+	}
+
 	for (int i = 0; i < 2; i++) {
 		ht = csv_iterate(d);
 		if (ht == NULL) {
-			errx(1, "no ht for run %d", run);
+			bf_errx(BF_EDATA, -1, "no ht for run %d", run);
 		}
 	}
 
 	csv_stopiter();
-	assert(ht->value > 0);
+	if (!(ht->value > 0)) {
+		bf_errx(BF_EDATA, -1, "bad ht for run %d", run);
+	}
 	return ht;
 }
 
+// Watch mode asks phy_settled() after every batch of rows, so each run
+// keeps its place in the force column, evicted round robin
+#define MAX_SCANS 8
+
+struct settle_scan {
+	int run;
+	struct event_scan s;
+};
+
+static struct settle_scan scans[MAX_SCANS] = { 0 };
+static int next_scan = 0;
+
+static struct event_scan *scan_for(int run) {
+	struct settle_scan *ss = NULL;
+
+	for (int i = 0; i < MAX_SCANS; i++) {
+		if (scans[i].run == run) {
+			return &scans[i].s;
+		}
+	}
+
+	ss = &scans[next_scan];
+	next_scan = (next_scan + 1) % MAX_SCANS;
+
+	bzero(ss, sizeof(struct settle_scan));
+	ss->run = run;
+	return &ss->s;
+}
+
+// Whether run has made it as far as landing, finding out without
+// dying over it if not. horizon is the last instant any metric uses.
+// Both ways of telling only look at rows that are new since last time:
+// the force scan resumes, and the hang time column stays resident and
+// gets appended to.
+int phy_settled(int run, double *horizon) {
+	const struct column *c = NULL;
+	struct desc force = {
+		.run = run,
+		.field = "Force(N)",
+	}, ht = {
+		.run = run,
+		.field = "Hang Time(s)",
+	};
+
+	assert_desc_valid(force);
+	assert(horizon != NULL);
+
+	if (csv_has_column(force) == 0) {
+		return 0;
+	}
+
+	if (force_events(run)) {
+		struct event up = { 0 }, down = { 0 };
+
+		if (sig_events_resume(csv_column(force), EVENT_OFF_N, EVENT_ON_N, scan_for(run), &up, &down) != 0) {
+			return 0;
+		}
+
+		*horizon = down.timestamp;
+		return 1;
+	}
+
+	// Takeoff, then landing
+	c = csv_column(ht);
+	if (c->n < 2) {
+		return 0;
+	}
+
+	*horizon = column_ts(c, 1);
+	return 1;
+}
+
 static double landing_time(int run) {
 	assert(run > 0);
 	return landing_datum(run)->timestamp;
@@ -54,155 +305,297 @@ static double hang_time(int run) {
 	return landing_datum(run)->value;
 }
 
+static struct dual lower_bound(void) {
+	return dual_const(bounded ? bounds[0] : 0);
+}
+
+static struct dual upper_bound(int run) {
+	assert(run > 0);
+	return bounded ? dual_const(bounds[1]) : takeoff_time(run);
+}
+
+static struct dual little_g(void) {
+	return dual_source(LITTLE_G, UCTY_G, UCTY_LITTLE_G);
+}
+
+static struct dual mass(void) {
+	return dual_source(MASS_KG, UCTY_MASS, MASS_UCTY_KG);
+}
+
 // MARK: Statistics
 
-static double phy_impulse_ucty(double unused) {
-	return FORCEPLATE_UCTY_N;
-#pragma unused(unused)
+static struct dual phy_impulse_ucty(double f) {
+	return dual_source(f, UCTY_FORCEPLATE, FORCEPLATE_UCTY_N);
 }
 
-struct result phy_vimpulse(int run) {
-	double ub = -1;
+static struct dual vimpulse(int run) {
 	struct desc d = {
 		.run = run,
 		.field = "Force(N)",
 	};
 
 	assert_desc_valid(d);
-	ub = takeoff_time(run);
-	return math_intdt(d, 0, ub, phy_impulse_ucty);
+	return math_intdt(d, lower_bound(), upper_bound(run), phy_impulse_ucty, rule);
+}
+
+struct result phy_vimpulse(int run) {
+	return dual_result(vimpulse(run));
 }
 
 struct result phy_himpulse(int run) {
-	double ub = -1;
 	struct desc d = {
 		.run = run,
 		.field = "Lateral Force(N)",
 	};
 
 	assert_desc_valid(d);
-	ub = takeoff_time(run);
-	return math_intdt(d, 0, ub, phy_impulse_ucty);
+	return dual_result(math_intdt(d, lower_bound(), upper_bound(run), phy_impulse_ucty, rule));
 }
 
 struct result phy_rawheight(int run) {
-	struct result r = { 0 };
 	double airtime = 0;
 
 	assert(run > 0);
 	airtime = hang_time(run);
 
-	r.value = LITTLE_G * pow(airtime, 2) / 8;
-	r.ucty = pow(airtime, 2) * UCTY_LITTLE_G / 8;
-	return r;
+	return dual_result(dual_scale(little_g(), pow(airtime, 2) / 8));
+}
+
+static struct dual jump_velocity(struct dual impulse) {
+	return dual_div(impulse, mass());
 }
 
-static struct result jump_velocity(int run) {
-	struct result r = { 0 }, vi = { 0 };
+static struct dual impheight(struct dual impulse) {
+	struct dual vel = { 0 };
+
+	// 1. Figure out initial velocity
+	vel = jump_velocity(impulse);
+
+	// 2. Do the maths
+	return dual_div(dual_mul(vel, vel), dual_scale(little_g(), 2));
+}
 
+struct result phy_impheight(int run) {
 	assert(run > 0);
-	vi = phy_vimpulse(run);
+	return dual_result(impheight(vimpulse(run)));
+}
 
-	r.value = vi.value / MASS_KG;
-	{
-		double ucty_p = (1 / MASS_KG) * vi.ucty;
-		double ucty_m = (vi.value / pow(MASS_KG, 2)) * MASS_UCTY_KG;
+struct datum phy_comdrop(int run, trajf traj, void *ctx) {
+	struct desc d = {
+		.run = run,
+		.field = "Z-axis acceleration(m/s2)",
+	};
+
+	assert_desc_valid(d);
+	return math_dintdt_min(d, lower_bound().value, upper_bound(run).value, rule, traj, ctx);
+}
 
-		r.ucty = sqrt(pow(ucty_p, 2) + pow(ucty_m, 2));
+// MARK: The great push for I
+
+// Plate and IMU, on one timebase
+static const char *i_fields[] = {
+	"Lateral Force(N)",
+	"Z-angular velocity(rad/s)",
+};
+
+#define I_LATERAL 0
+#define I_W 1
+
+static struct dual maxw(const struct frame *f, double cutoff) {
+	double w_max = -HUGE_VAL;
+
+	for (size_t i = 0; i < f->n && frame_ts(f, i) <= cutoff; i++) {
+		w_max = fmax(w_max, f->v[i * (size_t)f->nch + I_W]);
 	}
 
-	return r;
+	return dual_source(w_max, UCTY_W, W_UCTY_RADSPERSEC);
 }
 
-struct result phy_impheight(int run) {
-	struct result r = { 0 }, vel = { 0 };
+// Lever arm is the same (systematically wrong) COM_M for every
+// sample, so its error no longer gets RSS'd away across the integral.
+static struct dual phy_torque_ucty(double f) {
+	return dual_mul(phy_impulse_ucty(f), dual_source(COM_M, UCTY_COM, COM_UCTY_M));
+}
+
+struct result phy_i(int run) {
+	static struct frame f = { 0 };
+	const struct column *cols[2] = { 0 };
+	struct dual momentum = { 0 };
 
-	// 1. Figure out initial velocity
 	assert(run > 0);
-	vel = jump_velocity(run);
 
-	// 2. Do the maths
-	r.value = pow(vel.value, 2) / (2 * LITTLE_G);
-	{
-		double ucty_v = vel.value * vel.ucty / LITTLE_G;
-		double ucty_g = pow(vel.value, 2) * UCTY_LITTLE_G / (2 * pow(LITTLE_G, 2));
+	// 1. Line the sensors up
+	sig_columns(run, i_fields, 2, cols);
+	sig_align(&f, cols, 2, 0, interp);
+
+	// 2. Integrate over lateral forces AKA lateral torques at launch
+	momentum = math_intdt_frame(&f, I_LATERAL, lower_bound(), upper_bound(run), phy_torque_ucty, rule);
+
+	// 3. Moment of inertia!
+	return dual_result(dual_div(momentum, maxw(&f, landing_time(run))));
+}
+
+// MARK: Sensor lag
 
-		r.ucty = sqrt(pow(ucty_v, 2) + pow(ucty_g, 2));
+// Uniform within the timebase the correlation peak was interpolated on
+struct result phy_lag(int run) {
+	struct result r = { 0 };
+	double resolution = 0;
+
+	assert(run > 0);
+
+	if (synced == 0) {
+		bf_errx(BF_EINVAL, -1, "not synchronizing sensors");
 	}
 
+	r.value = sig_sync_lag(run, &resolution);
+	r.ucty = resolution / sqrt(12);
 	return r;
 }
 
-
-struct datum phy_comdrop(int run) {
-	double takeoff = 0;
-	struct desc d = {
+// MARK: Sweeping
+
+// How much everything hangs on exactly where takeoff is. Each integral
+// gets one pass over its samples for the whole sweep, and the rest is
+// worked out from those.
+double phy_sweep(int run, int flip, const double *offsets, int n, struct result (*out)[NUM_METRICS]) {
+	static struct dual v[MAX_SWEEP] = { 0 }, h[MAX_SWEEP] = { 0 }, l[MAX_SWEEP] = { 0 };
+	static struct frame f = { 0 };
+	const struct column *cols[2] = { 0 };
+	struct dual lb = { 0 }, ub = { 0 }, w = { 0 };
+	struct result raw = { 0 };
+	struct desc force = {
 		.run = run,
-		.field = "Z-axis acceleration(m/s2)",
+		.field = "Force(N)",
+	}, lateral = {
+		.run = run,
+		.field = "Lateral Force(N)",
 	};
 
-	assert_desc_valid(d);
-	takeoff = takeoff_time(run);
-	return math_dintdt_min(d, 0, takeoff);
-}
+	assert_desc_valid(force);
+	assert(offsets != NULL && out != NULL);
+	assert(n > 0 && n <= MAX_SWEEP);
 
-// MARK: The great push for I
+	lb = lower_bound();
+	ub = upper_bound(run);
 
-struct result phy_maxw(int run) {
-	double cutoff = 0;
-	struct result rout = {
-		.value = -HUGE_VAL,
-		.ucty = W_UCTY_RADSPERSEC
-	};
+	// 1. Integrals, one pass apiece
+	math_intdt_sweep(force, lb, ub, offsets, n, phy_impulse_ucty, rule, v);
+	math_intdt_sweep(lateral, lb, ub, offsets, n, phy_impulse_ucty, rule, h);
 
-	struct desc d = {
-		.run = run,
-		.field = "Z-angular velocity(rad/s)",
-	};
+	if (flip != 0) {
+		sig_columns(run, i_fields, 2, cols);
+		sig_align(&f, cols, 2, 0, interp);
+		math_intdt_frame_sweep(&f, I_LATERAL, lb, ub, offsets, n, phy_torque_ucty, rule, l);
+		w = maxw(&f, landing_time(run));
+	}
 
-	assert_desc_valid(d);
-	cutoff = landing_time(run);
-
-	for (int i = 0; i < MAX_DATUMS; i++) {
-		struct datum *w = csv_iterate(d);
-		if (w->timestamp > cutoff) {
-			break;
-		} else if (w->value > rout.value) {
-			rout.value = w->value;
+	// 2. Everything downstream of them. Hang time doesn't care.
+	raw = phy_rawheight(run);
+
+	for (int k = 0; k < n; k++) {
+		bzero(out[k], sizeof(out[k]));
+		out[k][METRIC_VIMPULSE] = dual_result(v[k]);
+		out[k][METRIC_HIMPULSE] = dual_result(h[k]);
+		out[k][METRIC_RAWHEIGHT] = raw;
+		out[k][METRIC_IMPHEIGHT] = dual_result(impheight(v[k]));
+
+		if (flip != 0) {
+			out[k][METRIC_I] = dual_result(dual_div(l[k], w));
 		}
 	}
 
-	return rout;
+	if (synced != 0) {
+		struct result lag = phy_lag(run);
+
+		for (int k = 0; k < n; k++) {
+			out[k][METRIC_LAG] = lag;
+		}
+	}
+
+	return ub.value;
 }
 
-static double phy_torque_ucty(double t) {
-	return sqrt(pow(t * COM_UCTY_M, 2) + pow(COM_M * FORCEPLATE_UCTY_N, 2));
+// MARK: Rolling windows
+
+struct roll_ctx {
+	rollf emit;
+	void *ctx;
+};
+
+// Mean power over the window is the work the plate did on us, starting
+// from rest at lb: kinetic energy from the net impulse J, plus potential
+// from how far the COM got, which is inner / m - g t^2 / 2.
+static void roll_window(const struct roll_window *w, void *ctx) {
+	struct roll_ctx *rc = (struct roll_ctx *)ctx;
+	struct roll_metrics out = { 0 };
+	struct dual m = mass(), g = little_g(), mg = dual_mul(m, g);
+	struct dual gross = w->integral, net = { 0 }, work = { 0 };
+	double t = w->ub - w->lb, c = 0, var = 0;
+
+	assert(rc != NULL && rc->emit != NULL);
+	assert(t > 0);
+
+	// 1. The easy ones
+	out.lb = w->lb;
+	out.ub = w->ub;
+	out.impulse = dual_result(w->integral);
+	out.peak = dual_result(dual_source(w->max, UCTY_FORCEPLATE, FORCEPLATE_UCTY_N));
+	out.low = dual_result(dual_source(w->min, UCTY_FORCEPLATE, FORCEPLATE_UCTY_N));
+
+	// 2. Power, leaving the plate's noise out of the duals...
+	gross.d[UCTY_FORCEPLATE] = 0;
+	net = dual_sub(gross, dual_scale(mg, t));
+	work = dual_div(dual_mul(net, net), dual_scale(m, 2));
+	work = dual_add(work, dual_scale(g, w->inner));
+	work = dual_sub(work, dual_scale(dual_mul(mg, g), t * t / 2));
+
+	// 3. ...since each step's share of it moves the work by
+	// J / m + g (ub - tau), with tau wherever that step was
+	c = net.value / m.value + g.value * w->ub;
+	var = c * c * w->noise[0] - 2 * c * g.value * w->noise[1] + g.value * g.value * w->noise[2];
+	work.d[UCTY_FORCEPLATE] = sqrt(fmax(var, 0));
+
+	out.power = dual_result(dual_scale(work, 1 / t));
+	rc->emit(&out, rc->ctx);
 }
 
-struct result phy_i(int run) {
-	struct result momentum = { 0 }, maxw = { 0 }, rout = { 0 };
+void phy_roll(int run, double width, double step, rollf emit, void *ctx) {
+	struct roll_ctx rc = {
+		.emit = emit,
+		.ctx = ctx,
+	};
 	struct desc d = {
 		.run = run,
-		.field = "Lateral Force(N)",
+		.field = "Force(N)",
 	};
 
 	assert_desc_valid(d);
-	assert(COM_M == 1); // TODO: FIXME!
+	assert(width > 0 && step > 0);
+	assert(emit != NULL);
 
-	// 1. Compute maximum angular velocity
-	maxw = phy_maxw(run);
+	math_roll(d, bounded ? bounds[0] : 0, bounded ? bounds[1] : INFINITY, width, step, phy_impulse_ucty, roll_window, &rc);
+}
 
-	// 2. Integrate over lateral forces AKA lateral torques at launch
-	momentum = math_intdt(d, 0, takeoff_time(run), phy_torque_ucty);
+// MARK: Table of everything
 
-	// 3. Moment of inertia!
-	rout.value = momentum.value / maxw.value;
-	{
-		double ucty_p = momentum.ucty / maxw.value;
-		double ucty_w = momentum.value * maxw.ucty / pow(maxw.value, 2);
+static const struct metric metrics[NUM_METRICS] = {
+	[METRIC_VIMPULSE] = { "Vertical Impulse", "vimpulse", "N s", 0, 0, phy_vimpulse },
+	[METRIC_HIMPULSE] = { "Horizontal Impulse", "himpulse", "N s", 0, 0, phy_himpulse },
+	[METRIC_RAWHEIGHT] = { "True height achieved", "rawheight", "m", 0, 0, phy_rawheight },
+	[METRIC_IMPHEIGHT] = { "Height via impulse (at feet)", "impheight", "m", 0, 0, phy_impheight },
+	[METRIC_I] = { "Moment of inertia", "i", "kg m^2", 1, 0, phy_i },
+	[METRIC_LAG] = { "IMU lag behind plate", "lag", "s", 0, 1, phy_lag },
+};
 
-		rout.ucty = sqrt(pow(ucty_p, 2) + pow(ucty_w, 2));
-	}
+const struct metric *phy_metric(int m) {
+	assert(m >= 0 && m < NUM_METRICS);
+	return &metrics[m];
+}
+
+// Whether m is part of what gets reported for a run
+int phy_reports(int m, int flip) {
+	const struct metric *mt = phy_metric(m);
 
-	return rout;
+	return (mt->flip_only == 0 || flip != 0) && (mt->sync_only == 0 || synced != 0);
 }
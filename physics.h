@@ -3,6 +3,7 @@
 
 #include <sys/types.h>
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -10,6 +11,14 @@
 
 #define MAX_DATUMS 10000
 
+// Packed columns get the same bytes as floats: 4 * MAX_DATUMS values
+// on a regular grid, or half that with an offset for each. Scratch
+// that works on a column's samples is sized for the most either
+// layout can hold.
+#define MAX_PACKED (4 * MAX_DATUMS)
+#define PACKED_OFF (MAX_PACKED / 2)
+#define MAX_SAMPLES MAX_PACKED
+
 struct desc {
 	int run;
 	const char *field;
@@ -22,23 +31,245 @@ struct datum {
 	double value;
 };
 
+// A whole column, resident. Parallel arrays so loops over
+// just the values stay tight.
+//
+// Packed columns keep values as floats, and timestamps as t0 + i * dt
+// plus, once samples stop landing on that grid, a float offset from
+// it. Values fill the packed arm from the front, and offsets from
+// PACKED_OFF, so a packed column holds four times what a wide one
+// does in the same static bytes while it's on the grid, and twice as
+// many once it's off. column_capacity() says which. Go through
+// column_ts() and column_v() rather than the union.
+struct column {
+	int run;
+	char field[BUFSIZ];
+	unsigned long serial;	// bumped every load or append, for derived caches
+	unsigned long origin;	// serial as loaded; appends leave it be
+
+	int col;
+	int ts_col;
+	int ended;		// ran out of timestamps before EOF
+
+	size_t n;
+	int packed;
+	int irregular;		// packed and off the grid; offsets valid
+	double t0;
+	double dt;
+
+	// Last, and never cleared wholesale
+	union {
+		struct {
+			double ts[MAX_DATUMS];
+			double v[MAX_DATUMS];
+		} wide;
+		float packed[MAX_PACKED];
+	} s;
+};
+
+static inline double column_ts(const struct column *c, size_t i) {
+	if (c->packed == 0) {
+		return c->s.wide.ts[i];
+	}
+
+	return c->t0 + (double)i * c->dt + (c->irregular ? c->s.packed[PACKED_OFF + i] : 0);
+}
+
+static inline double column_v(const struct column *c, size_t i) {
+	return c->packed ? c->s.packed[i] : c->s.wide.v[i];
+}
+
+void column_clear(struct column *c);
+void column_rewind(struct column *c);
+size_t column_capacity(const struct column *c);
+void column_push(struct column *c, double ts, double v);
+void column_copy(struct column *dst, const struct column *src);
+void column_shift(struct column *c, double dt);
+
+void csv_set_packed(int packed);
+int csv_packed(void);
+void csv_set_delimiter(char d);
+char csv_delimiter(void);
 void csv_initialize(char *path);
+int csv_has_column(struct desc d);
 struct datum *csv_iterate(struct desc d);
 void csv_stopiter(void);
+void csv_columns(int run, const char **fields, int n, const struct column **out);
+const struct column *csv_column(struct desc d);
 void csv_finalize(void);
+int csv_active(void);
+void csv_recover(void);
+void csv_locate(long offset, long *row, int *col);
+
+// Watch mode
+struct csv_change {
+	int run;
+	double since;	// earliest new timestamp
+};
+
+int csv_watch(void);
+int csv_refresh(struct csv_change *changes, int max, int *partial);
 
 // math.c
 
-typedef double (*uctyf)(double value);
+// Named sources of uncertainty. Each partial in a dual is stored
+// pre-scaled by the sigma of its source (i.e. "how far does the
+// value move if this source is off by one sigma"), so the total
+// uncertainty is just the RSS of the partials, and anything that
+// shows up twice (hi, MASS_KG) adds linearly before the RSS like
+// Taylor says it should.
+enum ucty_src {
+	UCTY_FORCEPLATE,	// independent per sample
+	UCTY_MASS,
+	UCTY_G,
+	UCTY_COM,
+	UCTY_W,
+	UCTY_TAKEOFF,
+	UCTY_QUADRATURE,	// the integration rule's own error estimate
+	NUM_UCTY_SRCS
+};
+
+struct dual {
+	double value;
+	double d[NUM_UCTY_SRCS];
+};
 
 struct result {
 	double value;
 	double ucty;
 };
 
-struct result math_intdt(struct desc d, double lb, double ub, uctyf ucty);
-double math_dintdt_bestcond(struct desc d, double lb, double ub);
-struct datum math_dintdt_min(struct desc d, double lb, double ub);
+struct dual dual_const(double value);
+struct dual dual_source(double value, enum ucty_src src, double sigma);
+struct dual dual_add(struct dual a, struct dual b);
+struct dual dual_sub(struct dual a, struct dual b);
+struct dual dual_mul(struct dual a, struct dual b);
+struct dual dual_div(struct dual a, struct dual b);
+struct dual dual_scale(struct dual a, double k);
+struct result dual_result(struct dual a);
+
+// Maps an (averaged) sample onto the integrand, partials and all.
+typedef struct dual (*uctyf)(double value);
+
+// Integration rules. Trapezoids are what there's always been; Simpson
+// is fourth order, and reports its error as UCTY_QUADRATURE.
+#define QUAD_TRAPEZOID 0
+#define QUAD_SIMPSON 1
+
+struct dual math_intdt(struct desc d, struct dual lb, struct dual ub, uctyf ucty, int rule);
+struct frame;
+struct dual math_intdt_frame(const struct frame *f, int ch, struct dual lb, struct dual ub, uctyf ucty, int rule);
+// Same, at ub + offsets[k] for each k (ascending), in one pass
+void math_intdt_sweep(struct desc d, struct dual lb, struct dual ub, const double *offsets, int n, uctyf ucty, int rule, struct dual *out);
+void math_intdt_frame_sweep(const struct frame *f, int ch, struct dual lb, struct dual ub, const double *offsets, int n, uctyf ucty, int rule, struct dual *out);
+// Trajectory out of the double integrator: time, velocity, displacement
+typedef void (*trajf)(double ts, double vel, double disp, void *ctx);
+
+double math_dintdt_bestcond(struct desc d, double lb, double ub, int rule);
+struct datum math_dintdt_min(struct desc d, double lb, double ub, int rule, trajf traj, void *ctx);
+
+// One window out of math_roll(), from sample lb through sample ub
+struct roll_window {
+	double lb;
+	double ub;
+	struct dual integral;	// what math_intdt would say, with trapezoids
+	double inner;		// integral over the window of the integral from lb
+	double noise[3];	// per-sample variance of its steps, times 1, t, t^2
+	double max;
+	double min;
+};
+
+typedef void (*windowf)(const struct roll_window *w, void *ctx);
+
+void math_roll(struct desc d, double lb, double ub, double width, double step, uctyf ucty, windowf emit, void *ctx);
+
+// Running mean/variance of y, plus the least squares slope of y
+// against x, in a form that can be merged (Welford, Chan et al.)
+struct moments {
+	int64_t n;
+	double mx, my;
+	double m2x, m2y;	// sums of squared deviations
+	double cxy;		// sum of co-deviations
+};
+
+void moments_add(struct moments *m, double x, double y);
+void moments_merge(struct moments *into, const struct moments *from);
+double moments_var(const struct moments *m);
+double moments_slope(const struct moments *m);
+
+// sig.c
+
+#define MAX_CHANNELS 4
+
+#define INTERP_LINEAR 0
+#define INTERP_CUBIC 1
+
+// Several columns resampled onto one uniform timebase,
+// interleaved sample by sample: v[i * nch + ch]
+struct frame {
+	int nch;
+	size_t n;
+	double t0;
+	double dt;
+	double v[MAX_SAMPLES * MAX_CHANNELS];
+};
+
+struct event {
+	double timestamp;	// interpolated between samples
+	double slope;		// across the crossing, units/s
+};
+
+// How far sig_events_resume() got through a column that's still being
+// appended to, so the next look only covers what's new. Zeroed (or a
+// column that's been reloaded since) starts over from the top.
+struct event_scan {
+	unsigned long origin;
+	size_t pos;		// first sample not looked at yet
+	int stage;		// looking for load, takeoff, then landing
+	size_t up;
+};
+
+int sig_events(const struct column *c, double off, double on, struct event *takeoff, struct event *landing);
+int sig_events_resume(const struct column *c, double off, double on, struct event_scan *s, struct event *takeoff, struct event *landing);
+void sig_align(struct frame *f, const struct column **cols, int nch, double dt, int interp);
+double frame_ts(const struct frame *f, size_t i);
+
+#define FILTER_NONE 0
+#define FILTER_FIR 1
+#define FILTER_IIR 2
+
+#define MAX_TAPS 255
+#define DEFAULT_TAPS 31
+
+struct filter {
+	int kind;
+	double cutoff;	// Hz
+	int taps;	// FIR only; odd
+	int zerophase;
+	int decimate;	// keep every Nth sample after filtering
+};
+
+double sig_lag(const struct column *ref, const struct column *c, double maxlag, double *resolution);
+
+// Columns recorded against some clock other than ref's, all late by as
+// much as probe is behind ref. sig_column() slides them back.
+struct sync {
+	const char *ref;
+	const char *probe;
+	const char **followers;
+	int nfollowers;
+	double maxlag;		// s, either way
+};
+
+void sig_set_sync(const struct sync *s);
+double sig_sync_lag(int run, double *resolution);
+
+int sig_parse_filter(const char *spec, struct filter *f);
+void sig_set_filter(const struct filter *f);
+void sig_get_filter(struct filter *f);
+void sig_filter(struct column *out, const struct column *in, const struct filter *f);
+const struct column *sig_column(struct desc d);
+void sig_columns(int run, const char **fields, int n, const struct column **out);
 
 // phy.c
 
@@ -51,14 +282,228 @@ struct datum math_dintdt_min(struct desc d, double lb, double ub);
 
 #define W_UCTY_RADSPERSEC 1
 
+// Plate thresholds for takeoff/landing detection when there's
+// no hang time column to go off of.
+#define EVENT_OFF_N 20
+#define EVENT_ON_N 50
+
+#define EVENTS_HANGTIME 0
+#define EVENTS_FORCE 1
+
+void phy_set_events(int src);
+void phy_set_interp(int interp);
+void phy_set_bounds(const double *bounds);
+void phy_set_sync(int sync);
+void phy_set_rule(int rule);
+int phy_events(void);
+int phy_interp(void);
+int phy_rule(void);
+int phy_synced(void);
+int phy_settled(int run, double *horizon);
+
+// Everything other than the capture that goes into a result, as text:
+// the constants here and in phy.c, BF_VERSION, and the settings above
+int phy_fingerprint(char *buf, size_t len);
+
 struct result phy_vimpulse(int run);
 struct result phy_himpulse(int run);
 
 struct result phy_rawheight(int run);
 struct result phy_impheight(int run);
 
-// struct datum phy_comdrop(int run);
+struct datum phy_comdrop(int run, trajf traj, void *ctx);
 
 struct result phy_i(int run);
 
+struct result phy_lag(int run);
+
+#define METRIC_VIMPULSE 0
+#define METRIC_HIMPULSE 1
+#define METRIC_RAWHEIGHT 2
+#define METRIC_IMPHEIGHT 3
+#define METRIC_I 4
+#define METRIC_LAG 5
+#define NUM_METRICS 6
+
+struct metric {
+	const char *name;
+	const char *key;
+	const char *units;
+	int flip_only;
+	int sync_only;		// only with phy_set_sync(1)
+	struct result (*f)(int run);
+};
+
+const struct metric *phy_metric(int m);
+int phy_reports(int m, int flip);
+
+// Every metric with the takeoff bound moved by each of offsets
+// (seconds, ascending). Returns where the bound was to begin with.
+#define MAX_SWEEP 1001
+
+double phy_sweep(int run, int flip, const double *offsets, int n, struct result (*out)[NUM_METRICS]);
+
+// Sliding windows over one long recording, with no takeoff to go off
+// of: all of them from lb to ub with -b, or the whole run without
+struct roll_metrics {
+	double lb;
+	double ub;
+	struct result impulse;	// N s, as vimpulse over [lb, ub]
+	struct result peak;	// N
+	struct result low;	// N
+	struct result power;	// W, mean from the plate, starting at rest
+};
+
+typedef void (*rollf)(const struct roll_metrics *m, void *ctx);
+
+void phy_roll(int run, double width, double step, rollf emit, void *ctx);
+
+// lib.c
+
+#define BF_OK 0
+#define BF_EIO 1	// couldn't read the capture
+#define BF_EFORMAT 2	// malformed CSV
+#define BF_ECOLUMN 3	// no such column
+#define BF_EDATA 4	// data doesn't support the analysis
+#define BF_ELIMIT 5	// over a compiled-in limit
+#define BF_EINVAL 6	// bad arguments
+
+#define BF_MSG 256
+
+// Bumped whenever the same capture and settings could come out
+// different, so results kept from before (cache.c) don't get reused
+#define BF_VERSION 1
+
+struct bf_error {
+	int code;
+	long row;	// 1 is the header; 0 if unknown
+	int col;	// from 1
+	long offset;	// bytes into the file, -1 if unknown
+	char msg[BF_MSG];
+};
+
+// What the core fails through, in place of err(3)/errx(3)
+__attribute__((__noreturn__, __format__(__printf__, 3, 4)))
+void bf_errx(int code, long offset, const char *fmt, ...);
+__attribute__((__noreturn__, __format__(__printf__, 1, 2)))
+void bf_err(const char *fmt, ...);
+
+int bf_open(const char *path, struct bf_error *e);
+int bf_metric(int run, int metric, struct result *out, struct bf_error *e);
+int bf_comdrop(int run, trajf traj, void *ctx, struct datum *out, struct bf_error *e);
+int bf_sweep(int run, int flip, const double *offsets, int n, double *ub, struct result (*out)[NUM_METRICS], struct bf_error *e);
+int bf_roll(int run, double width, double step, rollf emit, void *ctx, struct bf_error *e);
+void bf_close(void);
+
+// out.c
+
+#define OUT_TEXT 0
+#define OUT_JSONL 1
+#define OUT_BINARY 2
+
+// -o bin: one per run and metric, host byte order
+struct out_record {
+	int32_t run;
+	int16_t metric;		// METRIC_*
+	int16_t flip;
+	double value;
+	double ucty;
+};
+
+// -o bin with -W: one per run, metric and offset
+struct out_sweep_record {
+	int32_t run;
+	int16_t metric;
+	int16_t flip;
+	double offset;		// s, from where the upper bound would be
+	double ub;		// s, where it is
+	double value;
+	double ucty;
+};
+
+// -o bin with -R: one per run and window
+struct out_roll_record {
+	int32_t run;
+	int16_t flip;
+	int16_t reserved;
+	double lb;		// s
+	double ub;		// s
+	double impulse;		// N s
+	double impulse_ucty;
+	double peak;		// N
+	double peak_ucty;
+	double low;		// N
+	double low_ucty;
+	double power;		// W
+	double power_ucty;
+};
+
+int out_parse_format(const char *s);
+void out_set_format(int f);
+int out_format(void);
+void out_metric(int run, int flip, int metric, struct result r);
+void out_sweep(int run, int flip, int metric, double offset, double ub, struct result r);
+void out_roll(int run, int flip, const struct roll_metrics *m);
+void out_flush(void);
+
+// watch.c
+
+int watch_open(const char *path);
+void watch_wait(int wfd);
+
+// cat.c
+
+void cat_run(const char *catalog, int nworkers);
+
+// cache.c
+
+void cache_open(const char *dir, size_t budget);
+int cache_bind(const char *path);
+int cache_get(int run, int metric, struct result *out);
+void cache_put(int run, int metric, struct result r);
+
+// srv.c
+
+#define SRV_MAX_PATH 1024
+
+#define SRV_OK 0
+#define SRV_EFILE 1	// capture couldn't be analyzed
+#define SRV_EREQ 2	// malformed request
+
+// The client's settings, so asking the daemon gets the same answer as
+// not asking it. Workers take the rest on per query, but packed and
+// delimiter change how the file loads, so those get a worker apiece.
+struct srv_settings {
+	int32_t events;		// EVENTS_*
+	int32_t interp;		// INTERP_*
+	int32_t rule;		// QUAD_*
+	int32_t sync;
+	int32_t packed;
+	int32_t delimiter;
+	struct filter filter;
+};
+
+// Followed on the wire by pathlen bytes of path, no NUL.
+// Everything in host byte order; this is a local socket.
+struct srv_request {
+	int32_t run;
+	int32_t metric;
+	int32_t bounded;	// use lb/ub instead of [0, takeoff]
+	int32_t pathlen;
+	double lb;
+	double ub;
+	struct srv_settings settings;
+};
+
+struct srv_response {
+	int32_t status;
+	int32_t reserved;
+	double value;
+	double ucty;
+};
+
+void srv_run(const char *sockpath, size_t budget);
+int srv_connect(const char *sockpath);
+int srv_query(int fd, const char *path, int run, int metric, const double *bounds, struct result *out);
+
 #endif // PHYSICS_H
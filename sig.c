@@ -0,0 +1,809 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "physics.h"
+
+// Signal processing on loaded columns. Everything in here
+// works on struct column so it gets flat arrays to chew on;
+// packed columns get widened into scratch first.
+//
+// What the metrics see comes through sig_column(): the loaded column,
+// filtered and/or shifted onto the plate's clock as configured.
+
+// MARK: Scanning
+
+// Lanes per block. Comparisons within a block are branch free so
+// the compiler can turn them into vector compares; we only branch
+// once per block, and drop to scalar to pin down the exact sample.
+#define SIG_LANES 8
+
+// First index >= from where sign * v > sign * thresh, or n if none.
+static size_t scan_crossing(const double *v, size_t from, size_t n, double thresh, double sign) {
+	size_t i = from;
+	double st = sign * thresh;
+
+	assert(v != NULL);
+	assert(sign == 1 || sign == -1);
+
+	for (; i + SIG_LANES <= n; i += SIG_LANES) {
+		int hit = 0;
+
+		for (int k = 0; k < SIG_LANES; k++) {
+			hit |= (sign * v[i + k] > st);
+		}
+
+		if (hit != 0) {
+			break;
+		}
+	}
+
+	for (; i < n; i++) {
+		if (sign * v[i] > st) {
+			return i;
+		}
+	}
+
+	return n;
+}
+
+// Values of c as doubles from from on: the column itself if it's wide,
+// otherwise scratch, which is only good until the next call.
+static const double *widen(const struct column *c, size_t from, double *scratch) {
+	assert(c != NULL && scratch != NULL);
+
+	if (c->packed == 0) {
+		return c->s.wide.v;
+	}
+
+	for (size_t i = from; i < c->n; i++) {
+		scratch[i] = c->s.packed[i];
+	}
+
+	return scratch;
+}
+
+// Linear interpolation of where the signal hit thresh
+// between sample i - 1 and sample i
+static struct event interpolate(const struct column *c, size_t i, double thresh) {
+	struct event e = { 0 };
+	double dv = 0, dt = 0;
+
+	assert(i > 0 && i < c->n);
+
+	dv = column_v(c, i) - column_v(c, i - 1);
+	dt = column_ts(c, i) - column_ts(c, i - 1);
+	assert(dv != 0);
+
+	if (!(dt > 0)) {
+		bf_errx(BF_EDATA, -1, "time doesn't advance at %f s in %s for run %d", column_ts(c, i), c->field, c->run);
+	}
+
+	e.timestamp = column_ts(c, i - 1) + (thresh - column_v(c, i - 1)) / dv * dt;
+	e.slope = dv / dt;
+	return e;
+}
+
+// MARK: Events
+
+#define SCAN_LOAD 0
+#define SCAN_TAKEOFF 1
+#define SCAN_LANDING 2
+
+// Finds takeoff (dropping below off) and landing (coming back above on),
+// after the signal has first been above on. Returns 0 if both were found.
+int sig_events(const struct column *c, double off, double on, struct event *takeoff, struct event *landing) {
+	struct event_scan s = { 0 };
+
+	return sig_events_resume(c, off, on, &s, takeoff, landing);
+}
+
+// Same, carrying on from wherever s left off. Nothing before s->pos
+// crossed what we were looking for then, and appending rows doesn't
+// change that, so there's no need to look again.
+int sig_events_resume(const struct column *c, double off, double on, struct event_scan *s, struct event *takeoff, struct event *landing) {
+	static double scratch[MAX_SAMPLES] = { 0 };
+	const double *v = NULL;
+	size_t down = 0;
+
+	assert(c != NULL && s != NULL);
+	assert(takeoff != NULL && landing != NULL);
+	assert(on > off);
+
+	if (s->origin != c->origin || s->pos > c->n) {
+		bzero(s, sizeof(struct event_scan));
+		s->origin = c->origin;
+	}
+
+	v = widen(c, s->pos, scratch);
+
+	// 1. Somebody standing on the plate
+	if (s->stage == SCAN_LOAD) {
+		if ((s->pos = scan_crossing(v, s->pos, c->n, on, 1)) == c->n) {
+			return -1;
+		}
+		s->stage = SCAN_TAKEOFF;
+	}
+
+	// 2. ...who then leaves it
+	if (s->stage == SCAN_TAKEOFF) {
+		if ((s->pos = scan_crossing(v, s->pos, c->n, off, -1)) == c->n) {
+			return -1;
+		}
+		s->up = s->pos;
+		s->stage = SCAN_LANDING;
+	}
+
+	// 3. ...and comes back.
+	if ((down = scan_crossing(v, s->pos, c->n, on, 1)) == c->n) {
+		s->pos = down;
+		return -1;
+	}
+	s->pos = down;
+
+	*takeoff = interpolate(c, s->up, off);
+	*landing = interpolate(c, down, on);
+	return 0;
+}
+
+// MARK: Alignment
+
+double frame_ts(const struct frame *f, size_t i) {
+	assert(f != NULL);
+	assert(i < f->n);
+
+	return f->t0 + (double)i * f->dt;
+}
+
+// Cubic Hermite through samples j and j + 1, with finite difference
+// tangents so uneven spacing doesn't throw it off.
+static double tangent(const struct column *c, size_t j) {
+	size_t lo = (j > 0) ? j - 1 : j;
+	size_t hi = (j + 1 < c->n) ? j + 1 : j;
+
+	assert(hi > lo);
+	return (column_v(c, hi) - column_v(c, lo)) / (column_ts(c, hi) - column_ts(c, lo));
+}
+
+static double interp_cubic(const struct column *c, size_t j, double t) {
+	double h = column_ts(c, j + 1) - column_ts(c, j);
+	double s = (t - column_ts(c, j)) / h;
+	double s2 = s * s, s3 = s2 * s;
+
+	return (2 * s3 - 3 * s2 + 1) * column_v(c, j) + \
+		(s3 - 2 * s2 + s) * h * tangent(c, j) + \
+		(-2 * s3 + 3 * s2) * column_v(c, j + 1) + \
+		(s3 - s2) * h * tangent(c, j + 1);
+}
+
+static double interp_linear(const struct column *c, size_t j, double t) {
+	double s = (t - column_ts(c, j)) / (column_ts(c, j + 1) - column_ts(c, j));
+	return column_v(c, j) + s * (column_v(c, j + 1) - column_v(c, j));
+}
+
+// Merge join cols onto t0 + k * dt over the span they all cover. Every
+// channel keeps its own cursor, and cursors only ever move forward, so
+// this is one linear pass over everything. dt <= 0 means use the
+// finest spacing of any of the inputs.
+void sig_align(struct frame *f, const struct column **cols, int nch, double dt, int interp) {
+	size_t cursor[MAX_CHANNELS] = { 0 };
+	double t0 = -HUGE_VAL, t1 = HUGE_VAL;
+
+	assert(f != NULL && cols != NULL);
+	assert(nch > 0 && nch <= MAX_CHANNELS);
+	assert(interp == INTERP_LINEAR || interp == INTERP_CUBIC);
+
+	// 1. Figure out the common timebase
+	for (int ch = 0; ch < nch; ch++) {
+		const struct column *c = cols[ch];
+		double spacing = 0;
+
+		if (c->n < 2) {
+			bf_errx(BF_EDATA, -1, "can't align %s for run %d: too few samples", c->field, c->run);
+		}
+
+		spacing = (column_ts(c, c->n - 1) - column_ts(c, 0)) / (double)(c->n - 1);
+		if (!(spacing > 0)) {
+			bf_errx(BF_EDATA, -1, "time doesn't advance in %s for run %d", c->field, c->run);
+		}
+
+		if (dt <= 0 || spacing < dt) {
+			dt = spacing;
+		}
+
+		t0 = fmax(t0, column_ts(c, 0));
+		t1 = fmin(t1, column_ts(c, c->n - 1));
+	}
+
+	if (t1 <= t0) {
+		bf_errx(BF_EDATA, -1, "no overlap between channels for run %d", cols[0]->run);
+	}
+
+	// Every sample we use gets written below; leave the rest be
+	bzero(f, offsetof(struct frame, v));
+	f->nch = nch;
+	f->t0 = t0;
+	f->dt = dt;
+
+	// Small fudge so an endpoint sitting right on the grid makes it in
+	f->n = (size_t)floor((t1 - t0) / dt + 1e-9) + 1;
+	if (f->n > MAX_SAMPLES) {
+		bf_errx(BF_ELIMIT, -1, "huge csv");
+	}
+
+	// 2. Join
+	for (size_t k = 0; k < f->n; k++) {
+		double t = frame_ts(f, k);
+		double *row = &f->v[k * (size_t)nch];
+
+		for (int ch = 0; ch < nch; ch++) {
+			const struct column *c = cols[ch];
+			size_t j = cursor[ch];
+
+			while (j + 2 < c->n && column_ts(c, j + 1) <= t) {
+				j++;
+			}
+			cursor[ch] = j;
+
+			if (interp == INTERP_CUBIC) {
+				row[ch] = interp_cubic(c, j, t);
+			} else {
+				row[ch] = interp_linear(c, j, t);
+			}
+		}
+	}
+}
+
+// MARK: Lag
+
+// Twice the longest frame, so the correlation never wraps around
+#define FFT_MAX 131072
+
+static double fft_re[FFT_MAX] = { 0 };
+static double fft_im[FFT_MAX] = { 0 };
+
+// In place, iterative radix 2, n a power of two. The inverse isn't
+// scaled by 1 / n; nobody here needs it to be.
+static void fft(double *re, double *im, size_t n, int inverse) {
+	assert(re != NULL && im != NULL);
+	assert(n > 0 && n <= FFT_MAX && (n & (n - 1)) == 0);
+
+	// 1. Bit reversed order
+	for (size_t i = 1, j = 0; i < n; i++) {
+		size_t bit = n >> 1;
+
+		for (; (j & bit) != 0; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+
+		if (i < j) {
+			double tr = re[i], ti = im[i];
+
+			re[i] = re[j];
+			im[i] = im[j];
+			re[j] = tr;
+			im[j] = ti;
+		}
+	}
+
+	// 2. Butterflies, one twiddle at a time across the whole array
+	for (size_t len = 2; len <= n; len <<= 1) {
+		double angle = (inverse ? 2 : -2) * M_PI / (double)len;
+		size_t half = len / 2;
+
+		for (size_t k = 0; k < half; k++) {
+			double wr = cos(angle * (double)k), wi = sin(angle * (double)k);
+
+			for (size_t i = k; i < n; i += len) {
+				size_t j = i + half;
+				double xr = re[j] * wr - im[j] * wi;
+				double xi = re[j] * wi + im[j] * wr;
+
+				re[j] = re[i] - xr;
+				im[j] = im[i] - xi;
+				re[i] += xr;
+				im[i] += xi;
+			}
+		}
+	}
+}
+
+// How late c runs behind ref, in seconds, from the peak of their cross
+// correlation within maxlag either way. Both go onto one timebase first;
+// resolution is its spacing, which the peak is interpolated within.
+double sig_lag(const struct column *ref, const struct column *c, double maxlag, double *resolution) {
+	static struct frame f = { 0 };
+	const struct column *cols[2] = { ref, c };
+	double mean[2] = { 0 };
+	double peak = -HUGE_VAL, frac = 0;
+	long reach = 0, best = 0;
+	size_t n = 0, nfft = 1;
+
+	assert(ref != NULL && c != NULL);
+	assert(maxlag > 0);
+
+	// 1. One timebase, both signals less their means
+	sig_align(&f, cols, 2, 0, INTERP_LINEAR);
+	n = f.n;
+
+	while (nfft < 2 * n) {
+		nfft <<= 1;
+	}
+	assert(nfft <= FFT_MAX);
+
+	for (size_t i = 0; i < n; i++) {
+		mean[0] += f.v[2 * i];
+		mean[1] += f.v[2 * i + 1];
+	}
+	mean[0] /= (double)n;
+	mean[1] /= (double)n;
+
+	// 2. Both in one transform, ref real and c imaginary, zero padded
+	for (size_t i = 0; i < nfft; i++) {
+		fft_re[i] = (i < n) ? f.v[2 * i] - mean[0] : 0;
+		fft_im[i] = (i < n) ? f.v[2 * i + 1] - mean[1] : 0;
+	}
+
+	fft(fft_re, fft_im, nfft, 0);
+
+	// 3. Pull the two spectra back apart, from Z = REF + iC:
+	//	REF[k] = (Z[k] + conj(Z[-k])) / 2
+	//	C[k] = (Z[k] - conj(Z[-k])) / 2i
+	// and take conj(REF) C. Both inputs are real, so the cross
+	// spectrum at -k is the conjugate of the one at k.
+	for (size_t k = 0; k <= nfft / 2; k++) {
+		size_t j = (nfft - k) % nfft;
+		double rr = (fft_re[k] + fft_re[j]) / 2, ri = (fft_im[k] - fft_im[j]) / 2;
+		double cr = (fft_im[k] + fft_im[j]) / 2, ci = (fft_re[j] - fft_re[k]) / 2;
+		double xr = rr * cr + ri * ci, xi = rr * ci - ri * cr;
+
+		fft_re[k] = xr;
+		fft_im[k] = xi;
+		fft_re[j] = xr;
+		fft_im[j] = -xi;
+	}
+
+	// 4. Back to lags: entry m is sum ref[t] c[t + m], and
+	// negative m wrap around to the end
+	fft(fft_re, fft_im, nfft, 1);
+
+	reach = (long)fmin(floor(maxlag / f.dt), (double)(n - 1));
+	for (long m = -reach; m <= reach; m++) {
+		double y = fft_re[(size_t)((m + (long)nfft) % (long)nfft)];
+
+		if (y > peak) {
+			peak = y;
+			best = m;
+		}
+	}
+
+	// 5. Parabola through the peak and its neighbors
+	{
+		double y0 = fft_re[(size_t)((best - 1 + (long)nfft) % (long)nfft)];
+		double y2 = fft_re[(size_t)((best + 1) % (long)nfft)];
+		double curve = y0 - 2 * peak + y2;
+
+		if (curve < 0) {
+			frac = (y0 - y2) / (2 * curve);
+		}
+	}
+
+	if (resolution != NULL) {
+		*resolution = f.dt;
+	}
+
+	return ((double)best + frac) * f.dt;
+}
+
+// MARK: Filtering
+
+// Filtered (and shifted) copies of loaded columns, evicted round robin
+#define MAX_FILTERED 4
+
+struct filtered {
+	unsigned long serial;	// of the column we came from
+	double shift;		// onto the reference clock, s
+	struct column c;
+};
+
+static struct filter active = { .kind = FILTER_NONE, .decimate = 1 };
+static struct filtered filtered[MAX_FILTERED] = { 0 };
+static int next_filtered = 0;
+
+// FIR input with edges padded out, plus room for a whole final block
+static double padded[MAX_SAMPLES + MAX_TAPS + SIG_LANES] = { 0 };
+static double convolved[MAX_SAMPLES + SIG_LANES] = { 0 };
+
+static double sample_rate(const struct column *c) {
+	double span = 0;
+
+	assert(c->n > 1);
+	span = column_ts(c, c->n - 1) - column_ts(c, 0);
+	if (!(span > 0)) {
+		bf_errx(BF_EDATA, -1, "time doesn't advance in %s for run %d", c->field, c->run);
+	}
+
+	return (double)(c->n - 1) / span;
+}
+
+// Windowed sinc, Hamming window, unity gain at DC
+static void fir_design(double *h, int taps, double fc) {
+	int m = taps / 2;
+	double sum = 0;
+
+	assert(taps > 0 && taps <= MAX_TAPS && taps % 2 == 1);
+	assert(fc > 0 && fc < 0.5);
+
+	for (int k = 0; k < taps; k++) {
+		double x = k - m;
+		double sinc = (x == 0) ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+		double window = 0.54 - 0.46 * cos(2 * M_PI * k / (taps - 1));
+
+		h[k] = sinc * window;
+		sum += h[k];
+	}
+
+	for (int k = 0; k < taps; k++) {
+		h[k] /= sum;
+	}
+}
+
+// y[i] = sum_k h[k] * padded[i + k], SIG_LANES outputs at a time so the
+// inner loop is a straight vector multiply-add against one broadcast tap.
+static void fir_apply(double *v, size_t n, const struct filter *f, double fs) {
+	double h[MAX_TAPS] = { 0 };
+	size_t lead = 0, npad = 0;
+
+	fir_design(h, f->taps, f->cutoff / fs);
+
+	// Centered taps are zero phase; otherwise we're causal,
+	// and everything lands (taps - 1) / 2 samples late.
+	lead = (f->zerophase != 0) ? (size_t)f->taps / 2 : (size_t)f->taps - 1;
+	npad = n + (size_t)f->taps + SIG_LANES;
+
+	for (size_t j = 0; j < npad; j++) {
+		size_t src = (j < lead) ? 0 : j - lead;
+		padded[j] = v[(src < n) ? src : n - 1];
+	}
+
+	for (size_t i = 0; i < n; i += SIG_LANES) {
+		double acc[SIG_LANES] = { 0 };
+
+		for (int k = 0; k < f->taps; k++) {
+			double hk = h[k];
+			const double *x = &padded[i + (size_t)k];
+
+			for (int l = 0; l < SIG_LANES; l++) {
+				acc[l] += hk * x[l];
+			}
+		}
+
+		for (int l = 0; l < SIG_LANES; l++) {
+			convolved[i + (size_t)l] = acc[l];
+		}
+	}
+
+	memcpy(v, convolved, n * sizeof(double));
+}
+
+// One pass of a 2nd order Butterworth (RBJ cookbook low pass),
+// transposed direct form II, primed to steady state on the first
+// sample so there's no startup transient.
+static void biquad_pass(double *v, size_t n, double fc, int backwards) {
+	double w0 = 2 * M_PI * fc;
+	double alpha = sin(w0) / (2 * M_SQRT1_2);
+	double a0 = 1 + alpha;
+	double b0 = (1 - cos(w0)) / 2 / a0, b1 = (1 - cos(w0)) / a0, b2 = b0;
+	double a1 = -2 * cos(w0) / a0, a2 = (1 - alpha) / a0;
+	double x0 = backwards ? v[n - 1] : v[0];
+	double z2 = (b2 - a2) * x0;
+	double z1 = (b1 - a1) * x0 + z2;
+
+	assert(fc > 0 && fc < 0.5);
+
+	for (size_t k = 0; k < n; k++) {
+		size_t i = backwards ? n - 1 - k : k;
+		double x = v[i], y = b0 * x + z1;
+
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		v[i] = y;
+	}
+}
+
+static void iir_apply(double *v, size_t n, const struct filter *f, double fs) {
+	biquad_pass(v, n, f->cutoff / fs, 0);
+	if (f->zerophase != 0) {
+		biquad_pass(v, n, f->cutoff / fs, 1);
+	}
+}
+
+void sig_filter(struct column *out, const struct column *in, const struct filter *f) {
+	static double work[MAX_SAMPLES] = { 0 };
+	double fs = 0;
+
+	assert(out != NULL && in != NULL && f != NULL);
+	assert(out != in);
+	assert(f->decimate > 0);
+
+	column_copy(out, in);
+
+	if (f->kind == FILTER_NONE || in->n < 2) {
+		return;
+	}
+
+	for (size_t i = 0; i < in->n; i++) {
+		work[i] = column_v(in, i);
+	}
+
+	fs = sample_rate(in);
+	if (f->decimate > 1 && f->cutoff >= fs / 2 / f->decimate) {
+		warnx("cutoff %g Hz aliases after decimating %s by %d", f->cutoff, in->field, f->decimate);
+	}
+
+	// 1. Filter. Slow channels (the IMU) may have nothing
+	// above the cutoff to begin with.
+	switch (f->cutoff >= fs / 2 ? FILTER_NONE : f->kind) {
+		case FILTER_NONE:
+			break;
+		case FILTER_FIR:
+			fir_apply(work, in->n, f, fs);
+			break;
+		case FILTER_IIR:
+			iir_apply(work, in->n, f, fs);
+			break;
+		default:
+			assert(0);
+	}
+
+	// 2. Decimate, storing the same way the input was
+	column_rewind(out);
+	for (size_t i = 0; i < in->n; i += (size_t)f->decimate) {
+		column_push(out, column_ts(in, i), work[i]);
+	}
+}
+
+// kind:cutoff[,zp][,dec=N][,taps=N], e.g. "iir:30,zp,dec=4"
+int sig_parse_filter(const char *spec, struct filter *f) {
+	char buf[BUFSIZ] = { 0 };
+	char *cur = buf, *opt = NULL, *eptr = NULL;
+
+	assert(spec != NULL && f != NULL);
+
+	bzero(f, sizeof(struct filter));
+	f->taps = DEFAULT_TAPS;
+	f->decimate = 1;
+
+	if (strlen(spec) >= sizeof(buf)) {
+		return -1;
+	}
+	strncpy(buf, spec, sizeof(buf) - 1);
+
+	// 1. Kind
+	opt = strsep(&cur, ":");
+	if (strcmp(opt, "fir") == 0) {
+		f->kind = FILTER_FIR;
+	} else if (strcmp(opt, "iir") == 0) {
+		f->kind = FILTER_IIR;
+	} else {
+		return -1;
+	}
+
+	// 2. Cutoff
+	if (NULL == (opt = strsep(&cur, ","))) {
+		return -1;
+	}
+	f->cutoff = strtod(opt, &eptr);
+	if (eptr == opt || *eptr != '\0' || f->cutoff <= 0) {
+		return -1;
+	}
+
+	// 3. Knobs
+	while (NULL != (opt = strsep(&cur, ","))) {
+		long l = 0;
+
+		if (strcmp(opt, "zp") == 0) {
+			f->zerophase = 1;
+			continue;
+		} else if (strncmp(opt, "dec=", 4) == 0) {
+			l = strtol(opt + 4, &eptr, 10);
+			if (eptr == opt + 4 || *eptr != '\0' || l < 1 || l > MAX_SAMPLES) {
+				return -1;
+			}
+			f->decimate = (int)l;
+		} else if (strncmp(opt, "taps=", 5) == 0) {
+			l = strtol(opt + 5, &eptr, 10);
+			if (eptr == opt + 5 || *eptr != '\0' || l < 1 || l > MAX_TAPS || l % 2 == 0) {
+				return -1;
+			}
+			f->taps = (int)l;
+		} else {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void sig_set_filter(const struct filter *f) {
+	assert(f != NULL);
+	assert(f->kind == FILTER_NONE || f->cutoff > 0);
+
+	active = *f;
+	for (int i = 0; i < MAX_FILTERED; i++) {
+		filtered[i].serial = 0;
+		column_clear(&filtered[i].c);
+	}
+}
+
+void sig_get_filter(struct filter *f) {
+	assert(f != NULL);
+	*f = active;
+}
+
+// MARK: Synchronization
+
+// Lag estimates, evicted round robin
+#define MAX_LAGS 8
+
+struct lag {
+	int run;
+	unsigned long serial[2];	// of ref and probe, when estimated
+	double lag;
+	double resolution;
+};
+
+static struct sync sync = { 0 };
+static int syncing = 0;
+static struct lag lags[MAX_LAGS] = { 0 };
+static int next_lag = 0;
+
+void sig_set_sync(const struct sync *s) {
+	bzero(lags, sizeof(lags));
+
+	if (s == NULL) {
+		syncing = 0;
+		return;
+	}
+
+	assert(s->ref != NULL && s->probe != NULL && s->followers != NULL);
+	assert(s->nfollowers > 0);
+	assert(s->maxlag > 0);
+
+	sync = *s;
+	syncing = 1;
+}
+
+// How far the followers run behind ref for run, estimated once per load
+double sig_sync_lag(int run, double *resolution) {
+	const char *fields[2] = { sync.ref, sync.probe };
+	const struct column *cols[2] = { 0 };
+	struct lag *l = NULL;
+
+	assert(syncing != 0);
+	assert(run > 0);
+
+	csv_columns(run, fields, 2, cols);
+
+	for (int i = 0; i < MAX_LAGS && l == NULL; i++) {
+		if (lags[i].run == run && lags[i].serial[0] == cols[0]->serial && lags[i].serial[1] == cols[1]->serial) {
+			l = &lags[i];
+		}
+	}
+
+	if (l == NULL) {
+		l = &lags[next_lag];
+		next_lag = (next_lag + 1) % MAX_LAGS;
+
+		l->run = run;
+		l->serial[0] = cols[0]->serial;
+		l->serial[1] = cols[1]->serial;
+		l->lag = sig_lag(cols[0], cols[1], sync.maxlag, &l->resolution);
+	}
+
+	if (resolution != NULL) {
+		*resolution = l->resolution;
+	}
+
+	return l->lag;
+}
+
+// What to add to d's timestamps to put it on the reference clock.
+// This can load columns, so it happens before d's own gets loaded.
+static double shift_for(struct desc d) {
+	if (syncing == 0) {
+		return 0;
+	}
+
+	for (int i = 0; i < sync.nfollowers; i++) {
+		if (strcmp(d.field, sync.followers[i]) == 0) {
+			return -sig_sync_lag(d.run, NULL);
+		}
+	}
+
+	return 0;
+}
+
+// MARK: Derived columns
+
+// Filtered (and shifted) copy of c, made if it isn't already around.
+// Slots holding copies of anything in keep are off limits for eviction.
+static const struct column *filtered_column(const struct column *c, double shift, const struct column **keep, int nkeep) {
+	struct filtered *fc = NULL;
+
+	assert(c != NULL);
+	assert(nkeep >= 0 && nkeep < MAX_FILTERED);
+
+	for (int i = 0; i < MAX_FILTERED; i++) {
+		if (filtered[i].serial == c->serial && filtered[i].shift == shift) {
+			return &filtered[i].c;
+		}
+	}
+
+	for (int tries = 0; fc == NULL; tries++) {
+		assert(tries < MAX_FILTERED);
+		fc = &filtered[next_filtered];
+		next_filtered = (next_filtered + 1) % MAX_FILTERED;
+
+		for (int i = 0; i < nkeep; i++) {
+			if (keep[i] == &fc->c) {
+				fc = NULL;
+				break;
+			}
+		}
+	}
+
+	sig_filter(&fc->c, c, &active);
+	if (shift != 0) {
+		column_shift(&fc->c, shift);
+	}
+
+	fc->serial = c->serial;
+	fc->shift = shift;
+	return &fc->c;
+}
+
+// Loaded column, run through the active filter if there is one, and
+// moved onto the reference clock if it needs to be. Good until the
+// next load.
+const struct column *sig_column(struct desc d) {
+	const struct column *c = NULL;
+	double shift = 0;
+
+	assert_desc_valid(d);
+	shift = shift_for(d);
+	c = csv_column(d);
+
+	if (active.kind == FILTER_NONE && shift == 0) {
+		return c;
+	}
+
+	return filtered_column(c, shift, NULL, 0);
+}
+
+void sig_columns(int run, const char **fields, int n, const struct column **out) {
+	double shifts[MAX_FILTERED] = { 0 };
+
+	assert(fields != NULL && out != NULL);
+	assert(n > 0 && n < MAX_FILTERED);
+
+	for (int i = 0; i < n; i++) {
+		struct desc d = { .run = run, .field = fields[i] };
+
+		shifts[i] = shift_for(d);
+	}
+
+	csv_columns(run, fields, n, out);
+
+	for (int i = 0; i < n; i++) {
+		if (active.kind != FILTER_NONE || shifts[i] != 0) {
+			out[i] = filtered_column(out[i], shifts[i], out, i);
+		}
+	}
+}
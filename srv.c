@@ -0,0 +1,665 @@
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "physics.h"
+
+// Resident analysis daemon.
+//
+// Every capture we get asked about is handed to a worker process of
+// its own, which loads it once and then sits there answering queries.
+// Everything underneath us is static buffers and one CSV context, so a
+// process per capture is how more than one gets to stay resident; as a
+// bonus, a capture that errx()s only takes out its own worker.
+//
+// Workers are evicted least recently used first, whenever their
+// combined peak RSS goes over the budget.
+//
+// Clients are non-blocking, and each one's request piles up in its own
+// buffer over as many polls as it takes to arrive, so one that stalls
+// halfway through only holds up itself.
+
+#define MAX_WORKERS 32
+#define MAX_CLIENTS 16
+#define RESULT_CACHE 64
+
+struct worker {
+	pid_t pid;
+	int fd;
+	unsigned long used;	// LRU clock at last query
+	size_t rss;
+
+	// What we loaded and how, so we notice when it changes underneath us
+	char path[PATH_MAX];
+	off_t size;
+	struct timespec mtime;
+	int packed;
+	int delimiter;
+};
+
+// Worker -> server
+struct worker_reply {
+	struct srv_response r;
+	int64_t rss;
+};
+
+static struct worker workers[MAX_WORKERS] = { 0 };
+static unsigned long lru_clock = 0;
+
+struct client {
+	int fd;
+	size_t got;		// bytes of rq, then path, so far
+	struct srv_request rq;
+	char path[SRV_MAX_PATH];
+};
+
+static int listen_fd = -1;
+static struct client clients[MAX_CLIENTS] = { 0 };
+static int nclients = 0;
+
+// MARK: Utilities
+
+static int read_full(int fd, void *buf, size_t n) {
+	char *p = (char *)buf;
+
+	while (n > 0) {
+		ssize_t r = read(fd, p, n);
+
+		if (r < 0 && errno == EINTR) {
+			continue;
+		} else if (r <= 0) {
+			return -1;
+		}
+
+		p += r;
+		n -= (size_t)r;
+	}
+
+	return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t n) {
+	const char *p = (const char *)buf;
+
+	while (n > 0) {
+		ssize_t r = write(fd, p, n);
+
+		if (r < 0 && errno == EINTR) {
+			continue;
+		} else if (r <= 0) {
+			return -1;
+		}
+
+		p += r;
+		n -= (size_t)r;
+	}
+
+	return 0;
+}
+
+// Peak RSS in bytes. macOS reports bytes, everyone else kilobytes.
+static size_t peak_rss(void) {
+	struct rusage ru = { 0 };
+
+	if (getrusage(RUSAGE_SELF, &ru) != 0) {
+		err(1, "getrusage");
+	}
+
+#ifdef __APPLE__
+	return (size_t)ru.ru_maxrss;
+#else
+	return (size_t)ru.ru_maxrss * 1024;
+#endif
+}
+
+// To the nanosecond, since the dashboard rewrites captures at the
+// same size within the second. macOS spells it differently.
+static struct timespec mtime_of(const struct stat *sb) {
+#ifdef __APPLE__
+	return sb->st_mtimespec;
+#else
+	return sb->st_mtim;
+#endif
+}
+
+// Everything the setters would otherwise assert on
+static int settings_valid(const struct srv_settings *s) {
+	const struct filter *f = &s->filter;
+
+	if (s->events != EVENTS_HANGTIME && s->events != EVENTS_FORCE) {
+		return 0;
+	} else if (s->interp != INTERP_LINEAR && s->interp != INTERP_CUBIC) {
+		return 0;
+	} else if (s->rule != QUAD_TRAPEZOID && s->rule != QUAD_SIMPSON) {
+		return 0;
+	} else if ((s->sync != 0 && s->sync != 1) || (s->packed != 0 && s->packed != 1)) {
+		return 0;
+	} else if (s->delimiter <= 0 || s->delimiter > UCHAR_MAX || strchr("\"\r\n", s->delimiter) != NULL) {
+		return 0;
+	} else if (f->decimate < 1 || f->decimate > MAX_SAMPLES) {
+		return 0;
+	} else if (f->kind == FILTER_NONE) {
+		return 1;
+	} else if (f->kind != FILTER_FIR && f->kind != FILTER_IIR) {
+		return 0;
+	} else if (!(f->cutoff > 0 && isfinite(f->cutoff))) {
+		return 0;
+	}
+
+	return f->kind != FILTER_FIR || (f->taps >= 1 && f->taps <= MAX_TAPS && f->taps % 2 == 1);
+}
+
+static int request_valid(const struct srv_request *rq) {
+	if (rq->run <= 0 || rq->metric < 0 || rq->metric >= NUM_METRICS) {
+		return 0;
+	} else if (rq->pathlen <= 0 || rq->pathlen >= SRV_MAX_PATH) {
+		return 0;
+	} else if (rq->bounded != 0 && !(rq->lb >= 0 && rq->ub > rq->lb)) {
+		return 0;
+	}
+
+	return settings_valid(&rq->settings);
+}
+
+static int same_settings(const struct srv_settings *a, const struct srv_settings *b) {
+	const struct filter *fa = &a->filter, *fb = &b->filter;
+
+	if (a->events != b->events || a->interp != b->interp || a->rule != b->rule || a->sync != b->sync) {
+		return 0;
+	} else if (a->packed != b->packed || a->delimiter != b->delimiter) {
+		return 0;
+	}
+
+	return fa->kind == fb->kind && fa->cutoff == fb->cutoff && fa->taps == fb->taps && \
+		fa->zerophase == fb->zerophase && fa->decimate == fb->decimate;
+}
+
+// MARK: Workers
+
+struct cached_result {
+	int valid;
+	struct srv_request rq;
+	struct result r;
+};
+
+static int same_query(const struct srv_request *a, const struct srv_request *b) {
+	if (a->run != b->run || a->metric != b->metric || a->bounded != b->bounded) {
+		return 0;
+	} else if (same_settings(&a->settings, &b->settings) == 0) {
+		return 0;
+	}
+
+	return a->bounded == 0 || (a->lb == b->lb && a->ub == b->ub);
+}
+
+// Setting the filter or sync throws away what's derived from them,
+// so only when they've actually changed
+static void take_settings(const struct srv_settings *s) {
+	static struct srv_settings current = { 0 };
+	static int primed = 0;
+
+	if (primed != 0 && same_settings(&current, s)) {
+		return;
+	}
+
+	phy_set_events(s->events);
+	phy_set_interp(s->interp);
+	phy_set_rule(s->rule);
+	phy_set_sync(s->sync);
+	sig_set_filter(&s->filter);
+
+	current = *s;
+	primed = 1;
+}
+
+static void worker_main(int fd, const char *path, const struct srv_settings *s) {
+	static struct cached_result cache[RESULT_CACHE] = { 0 };
+	struct bf_error e = { 0 };
+	int next_cached = 0;
+
+	csv_set_packed(s->packed);
+	csv_set_delimiter((char)s->delimiter);
+	if (bf_open(path, &e) != BF_OK) {
+		errx(1, "%s", e.msg);
+	}
+
+	for (;;) {
+		struct srv_request rq = { 0 };
+		struct worker_reply reply = { 0 };
+		struct cached_result *hit = NULL;
+		int status = BF_OK;
+
+		if (read_full(fd, &rq, sizeof(rq)) != 0) {
+			// Server hung up on us
+			bf_close();
+			exit(0);
+		}
+
+		assert(request_valid(&rq));
+
+		for (int i = 0; i < RESULT_CACHE && hit == NULL; i++) {
+			if (cache[i].valid && same_query(&cache[i].rq, &rq)) {
+				hit = &cache[i];
+			}
+		}
+
+		if (hit == NULL) {
+			double b[2] = { rq.lb, rq.ub };
+			struct result r = { 0 };
+
+			// A bad run only costs us this query, not the worker
+			take_settings(&rq.settings);
+			phy_set_bounds(rq.bounded ? b : NULL);
+			if ((status = bf_metric(rq.run, rq.metric, &r, &e)) == BF_OK) {
+				hit = &cache[next_cached];
+				next_cached = (next_cached + 1) % RESULT_CACHE;
+
+				hit->r = r;
+				hit->rq = rq;
+				hit->valid = 1;
+			} else {
+				warnx("%s", e.msg);
+			}
+		}
+
+		if (status == BF_OK) {
+			reply.r.status = SRV_OK;
+			reply.r.value = hit->r.value;
+			reply.r.ucty = hit->r.ucty;
+		} else {
+			reply.r.status = SRV_EFILE;
+		}
+		reply.rss = (int64_t)peak_rss();
+
+		if (write_full(fd, &reply, sizeof(reply)) != 0) {
+			err(1, "worker reply");
+		}
+	}
+}
+
+static void retire(struct worker *w) {
+	int status = 0;
+
+	assert(w->pid > 0);
+
+	// Closing our end is the worker's cue to leave
+	close(w->fd);
+	if (waitpid(w->pid, &status, 0) < 0) {
+		warn("waitpid %d", w->pid);
+	}
+
+	bzero(w, sizeof(struct worker));
+}
+
+static struct worker *least_recent(const struct worker *spare) {
+	struct worker *victim = NULL;
+
+	for (int i = 0; i < MAX_WORKERS; i++) {
+		struct worker *w = &workers[i];
+
+		if (w->pid == 0 || w == spare) {
+			continue;
+		} else if (victim == NULL || w->used < victim->used) {
+			victim = w;
+		}
+	}
+
+	return victim;
+}
+
+static void enforce_budget(size_t budget, const struct worker *spare) {
+	for (;;) {
+		struct worker *victim = NULL;
+		size_t total = 0;
+
+		for (int i = 0; i < MAX_WORKERS; i++) {
+			total += workers[i].rss;
+		}
+
+		if (total <= budget || NULL == (victim = least_recent(spare))) {
+			return;
+		}
+
+		retire(victim);
+	}
+}
+
+static struct worker *spawn(const char *path, const struct stat *sb, const struct srv_settings *s) {
+	struct worker *w = NULL;
+	int sv[2] = { -1, -1 };
+
+	assert(strlen(path) < sizeof(w->path));
+
+	// 1. Find a slot, making one if we have to
+	for (int i = 0; i < MAX_WORKERS && w == NULL; i++) {
+		if (workers[i].pid == 0) {
+			w = &workers[i];
+		}
+	}
+
+	if (w == NULL) {
+		w = least_recent(NULL);
+		retire(w);
+	}
+
+	// 2. Fork off somebody to hold onto this
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+		err(1, "socketpair");
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	switch (w->pid = fork()) {
+		case -1:
+			err(1, "fork");
+		case 0:
+			// Don't hang onto anybody else's descriptors
+			close(sv[0]);
+			close(listen_fd);
+			for (int i = 0; i < nclients; i++) {
+				close(clients[i].fd);
+			}
+			for (int i = 0; i < MAX_WORKERS; i++) {
+				if (workers[i].pid > 0 && &workers[i] != w) {
+					close(workers[i].fd);
+				}
+			}
+
+			worker_main(sv[1], path, s);
+			// never reached
+			assert(0);
+		default:
+			break;
+	}
+
+	close(sv[1]);
+	w->fd = sv[0];
+	w->size = sb->st_size;
+	w->mtime = mtime_of(sb);
+	w->packed = s->packed;
+	w->delimiter = s->delimiter;
+	memcpy(w->path, path, strlen(path) + 1);
+	return w;
+}
+
+static struct worker *worker_for(const char *path, const struct stat *sb, const struct srv_settings *s) {
+	struct timespec mtime = mtime_of(sb);
+
+	for (int i = 0; i < MAX_WORKERS; i++) {
+		struct worker *w = &workers[i];
+
+		if (w->pid == 0 || strncmp(w->path, path, sizeof(w->path)) != 0) {
+			continue;
+		} else if (w->packed != s->packed || w->delimiter != s->delimiter) {
+			continue;
+		}
+
+		// Stale? Start over.
+		if (w->size != sb->st_size || w->mtime.tv_sec != mtime.tv_sec || w->mtime.tv_nsec != mtime.tv_nsec) {
+			retire(w);
+			break;
+		}
+
+		return w;
+	}
+
+	return spawn(path, sb, s);
+}
+
+// MARK: Serving
+
+static struct srv_response answer(const struct srv_request *rq, const char *rawpath, size_t budget) {
+	struct srv_response resp = { 0 };
+	struct worker_reply reply = { 0 };
+	struct worker *w = NULL;
+	struct stat sb = { 0 };
+	char path[PATH_MAX] = { 0 };
+
+	// 1. Who's got it?
+	if (realpath(rawpath, path) == NULL || stat(path, &sb) != 0) {
+		warn("%s", rawpath);
+		resp.status = SRV_EFILE;
+		return resp;
+	} else if (strlen(path) >= sizeof(w->path)) {
+		warnx("%s: path too long", rawpath);
+		resp.status = SRV_EFILE;
+		return resp;
+	}
+
+	w = worker_for(path, &sb, &rq->settings);
+
+	// 2. Ask them. Anything going wrong here means the worker
+	// died trying, which means the capture (or query) is bad.
+	if (write_full(w->fd, rq, sizeof(struct srv_request)) != 0 || \
+		read_full(w->fd, &reply, sizeof(reply)) != 0) {
+		warnx("worker for %s died", path);
+		retire(w);
+		resp.status = SRV_EFILE;
+		return resp;
+	}
+
+	w->used = ++lru_clock;
+	w->rss = (size_t)reply.rss;
+	enforce_budget(budget, w);
+
+	return reply.r;
+}
+
+// Reads what's there of the client's next request, without waiting
+// for the rest. Returns 1 once it's all here, 0 until then, and -1 once
+// the client's gone or sent something we can't make sense of.
+static int take_request(struct client *c) {
+	struct srv_response resp = { 0 };
+	char *dst = NULL;
+	size_t want = 0;
+	ssize_t n = 0;
+
+	// 1. The header, then as much path as it says
+	if (c->got < sizeof(c->rq)) {
+		dst = (char *)&c->rq + c->got;
+		want = sizeof(c->rq) - c->got;
+	} else {
+		dst = c->path + (c->got - sizeof(c->rq));
+		want = sizeof(c->rq) + (size_t)c->rq.pathlen - c->got;
+	}
+
+	n = read(c->fd, dst, want);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return 0;
+	} else if (n <= 0) {
+		return -1;
+	}
+
+	c->got += (size_t)n;
+
+	// 2. Can't trust pathlen either, so there's no resyncing after this
+	if (c->got == sizeof(c->rq) && request_valid(&c->rq) == 0) {
+		resp.status = SRV_EREQ;
+		write_full(c->fd, &resp, sizeof(resp));
+		return -1;
+	}
+
+	return c->got > sizeof(c->rq) && c->got == sizeof(c->rq) + (size_t)c->rq.pathlen;
+}
+
+// Returns -1 once the client's gone. One that isn't reading its answers
+// fills its socket up and gets dropped, rather than us waiting on it.
+static int serve_one(struct client *c, size_t budget) {
+	struct srv_response resp = { 0 };
+	int status = 0;
+
+	if ((status = take_request(c)) <= 0) {
+		return status;
+	}
+
+	resp = answer(&c->rq, c->path, budget);
+
+	bzero(&c->rq, sizeof(c->rq));
+	bzero(c->path, sizeof(c->path));
+	c->got = 0;
+
+	return write_full(c->fd, &resp, sizeof(resp));
+}
+
+static void drop_client(int i) {
+	assert(i >= 0 && i < nclients);
+
+	close(clients[i].fd);
+	clients[i] = clients[--nclients];
+}
+
+void srv_run(const char *sockpath, size_t budget) {
+	struct sockaddr_un sun = { 0 };
+	struct stat sb = { 0 };
+
+	assert(sockpath != NULL);
+
+	// 1. Set up shop
+	if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
+		err(1, "signal");
+	}
+
+	sun.sun_family = AF_UNIX;
+	if (strlen(sockpath) >= sizeof(sun.sun_path)) {
+		errx(1, "socket path too long");
+	}
+	strncpy(sun.sun_path, sockpath, sizeof(sun.sun_path) - 1);
+
+	// Leftover socket from last time?
+	if (lstat(sockpath, &sb) == 0 && S_ISSOCK(sb.st_mode)) {
+		unlink(sockpath);
+	}
+
+	if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		err(1, "socket");
+	} else if (bind(listen_fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		err(1, "bind %s", sockpath);
+	} else if (listen(listen_fd, MAX_CLIENTS) != 0) {
+		err(1, "listen");
+	}
+
+	// 2. Go!
+	for (;;) {
+		struct pollfd pfds[MAX_CLIENTS + 1] = { 0 };
+
+		pfds[0].fd = listen_fd;
+		pfds[0].events = POLLIN;
+		for (int i = 0; i < nclients; i++) {
+			pfds[i + 1].fd = clients[i].fd;
+			pfds[i + 1].events = POLLIN;
+		}
+
+		if (poll(pfds, (nfds_t)nclients + 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			err(1, "poll");
+		}
+
+		// Backwards, so dropping a client doesn't shuffle
+		// anybody we haven't gotten to yet
+		for (int i = nclients - 1; i >= 0; i--) {
+			if (pfds[i + 1].revents == 0) {
+				continue;
+			} else if (serve_one(&clients[i], budget) != 0) {
+				drop_client(i);
+			}
+		}
+
+		if (pfds[0].revents & POLLIN) {
+			int fd = accept(listen_fd, NULL, NULL);
+
+			if (fd < 0) {
+				warn("accept");
+			} else if (nclients == MAX_CLIENTS) {
+				warnx("too many clients");
+				close(fd);
+			} else if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+				warn("fcntl");
+				close(fd);
+			} else {
+				bzero(&clients[nclients], sizeof(struct client));
+				clients[nclients++].fd = fd;
+			}
+		}
+	}
+}
+
+// MARK: Client
+
+int srv_connect(const char *sockpath) {
+	struct sockaddr_un sun = { 0 };
+	int fd = -1;
+
+	assert(sockpath != NULL);
+
+	sun.sun_family = AF_UNIX;
+	if (strlen(sockpath) >= sizeof(sun.sun_path)) {
+		errx(1, "socket path too long");
+	}
+	strncpy(sun.sun_path, sockpath, sizeof(sun.sun_path) - 1);
+
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		err(1, "socket");
+	} else if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+		err(1, "connect %s", sockpath);
+	}
+
+	return fd;
+}
+
+// Returns the response status; out is only good for SRV_OK
+int srv_query(int fd, const char *path, int run, int metric, const double *bounds, struct result *out) {
+	struct srv_request rq = { 0 };
+	struct srv_response resp = { 0 };
+	size_t l = 0;
+
+	assert(path != NULL && out != NULL);
+
+	l = strlen(path);
+	if (l == 0 || l >= SRV_MAX_PATH) {
+		errx(1, "bad path for query: %s", path);
+	}
+
+	rq.run = run;
+	rq.metric = metric;
+	rq.pathlen = (int32_t)l;
+
+	// Whatever we'd have used ourselves
+	rq.settings.events = phy_events();
+	rq.settings.interp = phy_interp();
+	rq.settings.rule = phy_rule();
+	rq.settings.sync = phy_synced();
+	rq.settings.packed = csv_packed();
+	rq.settings.delimiter = (unsigned char)csv_delimiter();
+	sig_get_filter(&rq.settings.filter);
+	if (bounds != NULL) {
+		rq.bounded = 1;
+		rq.lb = bounds[0];
+		rq.ub = bounds[1];
+	}
+
+	if (write_full(fd, &rq, sizeof(rq)) != 0 || write_full(fd, path, l) != 0) {
+		err(1, "send query");
+	} else if (read_full(fd, &resp, sizeof(resp)) != 0) {
+		errx(1, "server hung up");
+	}
+
+	out->value = resp.value;
+	out->ucty = resp.ucty;
+	return resp.status;
+}
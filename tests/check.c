@@ -0,0 +1,779 @@
+#include <sys/types.h>
+
+#include <err.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "physics.h"
+
+// Checks on the core, against the little captures next to this file.
+// Their answers are worked out by hand in the comments, so a change
+// that moves a number has to say why.
+//
+//	check fixtures scratch
+//
+// scratch is somewhere we can write. Everything that's off gets said,
+// and the exit status is how many were.
+
+static const char *fixtures = NULL;
+static const char *scratch = NULL;
+static int failures = 0;
+
+// MARK: Helpers
+
+__attribute__((__format__(__printf__, 2, 3)))
+static void expect(int ok, const char *fmt, ...) {
+	va_list ap;
+
+	if (ok) {
+		return;
+	}
+
+	va_start(ap, fmt);
+	vwarnx(fmt, ap);
+	va_end(ap);
+	failures++;
+}
+
+static void expect_near(double got, double want, double tol, const char *what) {
+	expect(fabs(got - want) <= tol, "%s: got %.12g, wanted %.12g", what, got, want);
+}
+
+static const char *fixture(const char *name) {
+	static char path[BUFSIZ] = { 0 };
+
+	snprintf(path, sizeof(path), "%s/%s", fixtures, name);
+	return path;
+}
+
+// The value of a metric, or NAN after saying why not
+static double metric(int run, int m) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+
+	if (bf_metric(run, m, &r, &e) != BF_OK) {
+		expect(0, "run %d, %s: %s", run, phy_metric(m)->key, e.msg);
+		return NAN;
+	}
+
+	return r.value;
+}
+
+// MARK: Recovery
+
+// ramp.csv, every 10 ms: force goes 600 + 1000t N up to 0.4 s, and
+// it's 0 from takeoff at 0.41 s; landing is at 0.91 s. Lateral is
+// always 10 N. So run 1's
+//
+//	vimpulse = 600 * 0.4 + 500 * 0.4^2 + 1000 * 0.01 / 2 = 325 N s
+//	himpulse = 10 * 0.41 = 4.1 N s
+//	rawheight = 9.81 * 0.5^2 / 8 m
+//
+// and trapezoids get those exactly. Run 2 has a bad cell on row 22,
+// run 3 takes off on its first sample, and run 4's time column comes
+// after its force; none of them get to take the process down.
+static void check_recovery(void) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+
+	expect(bf_metric(1, METRIC_VIMPULSE, &r, &e) == BF_EINVAL, "metric with nothing open");
+	expect(bf_open(fixture("nonexistent.csv"), &e) == BF_EIO, "opened a file that isn't there");
+
+	if (bf_open(fixture("ramp.csv"), &e) != BF_OK) {
+		expect(0, "ramp.csv: %s", e.msg);
+		return;
+	}
+
+	// Left over from whoever had us embedded, and none of our business
+	errno = ERANGE;
+	expect_near(metric(1, METRIC_VIMPULSE), 325, 1e-9, "run 1 vimpulse");
+	expect_near(metric(1, METRIC_HIMPULSE), 4.1, 1e-9, "run 1 himpulse");
+	expect_near(metric(1, METRIC_RAWHEIGHT), 9.81 * 0.25 / 8, 1e-12, "run 1 rawheight");
+
+	// 1. Bad cell, with where it is
+	expect(bf_metric(2, METRIC_VIMPULSE, &r, &e) == BF_EFORMAT, "run 2: %s", e.msg);
+	expect(e.row == 22 && e.col == 6, "run 2: bad cell at row %ld, column %d", e.row, e.col);
+
+	// 2. Out of the data's hands: bounds and column order
+	expect(bf_metric(3, METRIC_VIMPULSE, &r, &e) == BF_EDATA, "run 3: %s", e.msg);
+	expect(bf_metric(4, METRIC_VIMPULSE, &r, &e) == BF_EFORMAT, "run 4: %s", e.msg);
+	expect(bf_metric(9, METRIC_VIMPULSE, &r, &e) == BF_ECOLUMN, "run 9: %s", e.msg);
+
+	// 3. None of which got in the way of run 1
+	expect_near(metric(1, METRIC_VIMPULSE), 325, 1e-9, "run 1 vimpulse, after");
+	expect(bf_metric(2, METRIC_VIMPULSE, &r, &e) == BF_EFORMAT, "run 2, again: %s", e.msg);
+
+	bf_close();
+}
+
+// MARK: Sensor sync
+
+// lag.csv: a 30 ms Gaussian on the plate at 0.4 s, every 5 ms, and the
+// same shape in Z-axis acceleration (every 10 ms, on a -g baseline)
+// 23.7 ms later. That's what -y should find, to well within the 5 ms
+// grid it correlates on, and it should say the grid is 5 ms. Then the
+// IMU's columns should come back with their peak moved onto the plate's.
+static void check_lag(void) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+	struct desc d = {
+		.run = 1,
+		.field = "Z-axis acceleration(m/s2)",
+	};
+	const struct column *c = NULL;
+	size_t peak = 0;
+
+	if (bf_open(fixture("lag.csv"), &e) != BF_OK) {
+		expect(0, "lag.csv: %s", e.msg);
+		return;
+	}
+
+	expect(bf_metric(1, METRIC_LAG, &r, &e) == BF_EINVAL, "lag without syncing");
+
+	phy_set_sync(1);
+	if (bf_metric(1, METRIC_LAG, &r, &e) != BF_OK) {
+		expect(0, "lag: %s", e.msg);
+	} else {
+		expect_near(r.value, 0.0237, 0.0005, "lag");
+		expect_near(r.ucty, 0.005 / sqrt(12), 1e-9, "lag ucty");
+
+		c = sig_column(d);
+		for (size_t i = 1; i < c->n; i++) {
+			peak = (column_v(c, i) > column_v(c, peak)) ? i : peak;
+		}
+
+		// The 10 ms sample nearest 0.4237 s is 0.42 s
+		expect_near(column_ts(c, peak), 0.42 - r.value, 1e-9, "shifted peak");
+	}
+
+	phy_set_sync(0);
+	bf_close();
+}
+
+// MARK: Result cache
+
+// A copy of ramp.csv, so it can be changed out from under the cache
+static const char *copy_ramp(void) {
+	static char path[BUFSIZ] = { 0 };
+	char buf[BUFSIZ] = { 0 };
+	FILE *in = NULL, *out = NULL;
+	size_t n = 0;
+
+	snprintf(path, sizeof(path), "%s/ramp.csv", scratch);
+	if (NULL == (in = fopen(fixture("ramp.csv"), "r"))) {
+		err(1, "%s", fixture("ramp.csv"));
+	} else if (NULL == (out = fopen(path, "w"))) {
+		err(1, "%s", path);
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, n, out);
+	}
+
+	fclose(in);
+	if (fclose(out) != 0) {
+		err(1, "%s", path);
+	}
+
+	return path;
+}
+
+// Whatever gets put comes back while nothing's changed, and doesn't
+// once the settings or a byte of the file have. Put back how they
+// were, the old entry's still there.
+static void check_cache(void) {
+	char dir[BUFSIZ] = { 0 };
+	const char *path = copy_ramp();
+	struct result r = { 0 }, put = { .value = 325, .ucty = 0.5 };
+	FILE *fp = NULL;
+
+	snprintf(dir, sizeof(dir), "%s/cache", scratch);
+	cache_open(dir, 1024 * 1024);
+
+	// 1. Nothing there, then there
+	expect(cache_bind(path) == 0, "bind");
+	expect(cache_get(1, METRIC_VIMPULSE, &r) != 0, "hit in an empty cache");
+	cache_put(1, METRIC_VIMPULSE, put);
+	expect(cache_get(1, METRIC_VIMPULSE, &r) == 0 && r.value == put.value && r.ucty == put.ucty, "miss after put");
+	expect(cache_get(1, METRIC_HIMPULSE, &r) != 0, "hit on a metric never put");
+	expect(cache_get(2, METRIC_VIMPULSE, &r) != 0, "hit on a run never put");
+
+	// 2. From disk, not memory
+	expect(cache_bind(path) == 0 && cache_get(1, METRIC_VIMPULSE, &r) == 0 && r.value == put.value, "miss after rebind");
+
+	// 3. Settings
+	phy_set_rule(QUAD_SIMPSON);
+	expect(cache_bind(path) == 0 && cache_get(1, METRIC_VIMPULSE, &r) != 0, "hit with another rule");
+	phy_set_rule(QUAD_TRAPEZOID);
+	expect(cache_bind(path) == 0 && cache_get(1, METRIC_VIMPULSE, &r) == 0, "miss with the rule back");
+
+	// 4. The file, by one byte
+	if (NULL == (fp = fopen(path, "a"))) {
+		err(1, "%s", path);
+	}
+	fputc('\n', fp);
+	fclose(fp);
+
+	expect(cache_bind(path) == 0 && cache_get(1, METRIC_VIMPULSE, &r) != 0, "hit after the file changed");
+}
+
+// MARK: Packed columns
+
+// n samples every ms of a 1.3 Hz wobble around 700 N, with lateral
+// force along for the ride. With jitter, every other timestamp is
+// 0.1 ms late, so it's off the grid from the second sample.
+static const char *write_long(const char *name, int n, int jitter) {
+	static char path[BUFSIZ] = { 0 };
+	FILE *fp = NULL;
+
+	snprintf(path, sizeof(path), "%s/%s", scratch, name);
+	if (NULL == (fp = fopen(path, "w"))) {
+		err(1, "%s", path);
+	}
+
+	fprintf(fp, "Data Set 1:Time(s),Data Set 1:Force(N),Data Set 1:Lateral Force(N),Data Set 1:Hang Time(s),\n");
+	for (int i = 0; i < n; i++) {
+		double t = i * 0.001 + ((jitter && i % 2) ? 0.0001 : 0);
+
+		fprintf(fp, "%.4f,%.3f,%.3f,,\n", t, 700 + 50 * sin(2 * M_PI * 1.3 * t), 10 + cos(t));
+	}
+
+	if (fclose(fp) != 0) {
+		err(1, "%s", path);
+	}
+
+	return path;
+}
+
+// vimpulse over [0, ub] one layout or the other, or NAN after saying
+// why not
+static double impulse_as(const char *path, int packed, double ub) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+	double bounds[2] = { 0, ub };
+
+	csv_set_packed(packed);
+	phy_set_bounds(bounds);
+
+	if (bf_open(path, &e) != BF_OK || bf_metric(1, METRIC_VIMPULSE, &r, &e) != BF_OK) {
+		expect(0, "%s, packed=%d: %s", path, packed, e.msg);
+		r.value = NAN;
+	}
+
+	phy_set_bounds(NULL);
+	csv_set_packed(0);
+	bf_close();
+	return r.value;
+}
+
+// Packed columns hold four times what wide ones do while they're on
+// the grid, and twice while they aren't. Where both fit, the floats
+// cost about a µN s: each sample's off by up to half a float ulp of
+// 700 N (3e-5 N), which mostly cancels over 9000 ms. Bounds sit
+// between samples, since t0 + i * dt can round a sample right on
+// one to the other side of it.
+static void check_packed(void) {
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+	double bounds[2] = { 0, 29.9005 };
+	double want = 700 * 29.9 + 50 * (1 - cos(2 * M_PI * 1.3 * 29.9)) / (2 * M_PI * 1.3);
+	const char *path = NULL;
+
+	// 1. Side by side, on something that fits either way
+	path = write_long("short.csv", 9000, 0);
+	expect_near(impulse_as(path, 1, 8.9005), impulse_as(path, 0, 8.9005), 1e-6, "packed vs wide");
+
+	// 2. Too long for wide...
+	path = write_long("long.csv", 30000, 0);
+	phy_set_bounds(bounds);
+	if (bf_open(path, &e) == BF_OK) {
+		expect(bf_metric(1, METRIC_VIMPULSE, &r, &e) == BF_ELIMIT, "30000 wide samples: %s", e.msg);
+	}
+	phy_set_bounds(NULL);
+	bf_close();
+
+	// ...but not packed, and right to within what trapezoids and
+	// floats get wrong
+	expect_near(impulse_as(path, 1, 29.9005), want, 1e-4, "30000 packed samples");
+
+	// 3. Off the grid, half as many fit
+	expect(!isnan(impulse_as(write_long("jitter.csv", 19000, 1), 1, 18.9005)), "19000 jittered samples");
+
+	csv_set_packed(1);
+	phy_set_bounds(bounds);
+	if (bf_open(write_long("jitter.csv", 21000, 1), &e) == BF_OK) {
+		expect(bf_metric(1, METRIC_VIMPULSE, &r, &e) == BF_ELIMIT, "21000 jittered samples: %s", e.msg);
+	}
+	phy_set_bounds(NULL);
+	csv_set_packed(0);
+	bf_close();
+}
+
+// MARK: Dialects
+
+struct dialect {
+	const char *file;
+	char delimiter;
+};
+
+// Run 1 of ramp.csv, as other things write it: semicolons with decimal
+// commas and CRLFs and no trailing delimiter, tabs, and RFC 4180 quotes
+// around some of it plus a notes column with commas, quotes and a
+// newline inside. Same numbers down to the bit. thousands.csv is
+// tab.csv with 1000 N written as 1,000.0, which isn't a number in any
+// dialect and mustn't come out as 1 N.
+static void check_dialects(void) {
+	static const struct dialect dialects[] = {
+		{ "semicolon.csv", ';' },
+		{ "tab.csv", '\t' },
+		{ "quoted.csv", ',' },
+	};
+	static const int metrics[] = { METRIC_VIMPULSE, METRIC_HIMPULSE, METRIC_RAWHEIGHT };
+	double want[3] = { 0 };
+	struct result r = { 0 };
+	struct bf_error e = { 0 };
+
+	if (bf_open(fixture("ramp.csv"), &e) != BF_OK) {
+		expect(0, "ramp.csv: %s", e.msg);
+		return;
+	}
+
+	for (int m = 0; m < 3; m++) {
+		want[m] = metric(1, metrics[m]);
+	}
+
+	for (size_t i = 0; i < sizeof(dialects) / sizeof(dialects[0]); i++) {
+		const struct dialect *d = &dialects[i];
+
+		csv_set_delimiter(d->delimiter);
+		if (bf_open(fixture(d->file), &e) != BF_OK) {
+			expect(0, "%s: %s", d->file, e.msg);
+			continue;
+		}
+
+		for (int m = 0; m < 3; m++) {
+			double got = metric(1, metrics[m]);
+
+			expect(got == want[m], "%s: %s is %.17g, not %.17g", d->file, phy_metric(metrics[m])->key, got, want[m]);
+		}
+	}
+
+	csv_set_delimiter('\t');
+	if (bf_open(fixture("thousands.csv"), &e) != BF_OK) {
+		expect(0, "thousands.csv: %s", e.msg);
+	} else {
+		expect(bf_metric(1, METRIC_VIMPULSE, &r, &e) == BF_EFORMAT, "thousands.csv: vimpulse %g", r.value);
+		expect(e.row == 42 && e.col == 2, "thousands.csv: bad cell at row %ld, column %d", e.row, e.col);
+	}
+
+	csv_set_delimiter(',');
+	bf_close();
+}
+
+// MARK: Rolling windows
+
+#define MAX_WINDOWS 128
+
+static struct roll_metrics windows[MAX_WINDOWS] = { 0 };
+static int nwindows = 0;
+
+static void keep_window(const struct roll_metrics *m, void *ctx) {
+	(void)ctx;
+
+	if (nwindows < MAX_WINDOWS) {
+		windows[nwindows] = *m;
+	}
+	nwindows++;
+}
+
+// wiggle.csv: 0.6 s every 2 ms of a 3 Hz wave plus noise, with a
+// six-sample plateau for the peak to tie on. Every 50 ms window,
+// 10 ms apart, against the samples themselves: same peak and low as
+// looking at each one, same impulse as trapezoids by hand and as
+// vimpulse with -b over the window. The last window to fit ends
+// at 0.59 s, so there are 55.
+static void check_roll(void) {
+	struct desc d = {
+		.run = 1,
+		.field = "Force(N)",
+	};
+	struct bf_error e = { 0 };
+	const struct column *c = NULL;
+
+	if (bf_open(fixture("wiggle.csv"), &e) != BF_OK) {
+		expect(0, "wiggle.csv: %s", e.msg);
+		return;
+	}
+
+	nwindows = 0;
+	if (bf_roll(1, 0.05, 0.01, keep_window, NULL, &e) != BF_OK) {
+		expect(0, "roll: %s", e.msg);
+		bf_close();
+		return;
+	}
+
+	expect(nwindows == 55, "%d windows", nwindows);
+	c = sig_column(d);
+
+	for (int k = 0; k < nwindows && k < MAX_WINDOWS; k++) {
+		const struct roll_metrics *w = &windows[k];
+		double hi = -HUGE_VAL, lo = HUGE_VAL, area = 0, bounds[2] = { w->lb, w->ub };
+		char what[64] = { 0 };
+
+		// 1. By brute force
+		for (size_t i = 0; i < c->n; i++) {
+			double t = column_ts(c, i), v = column_v(c, i);
+
+			if (t < w->lb || t > w->ub) {
+				continue;
+			}
+
+			hi = fmax(hi, v);
+			lo = fmin(lo, v);
+			if (i > 0 && column_ts(c, i - 1) >= w->lb) {
+				area += (t - column_ts(c, i - 1)) * (v + column_v(c, i - 1)) / 2;
+			}
+		}
+
+		snprintf(what, sizeof(what), "window %d (%g-%g s)", k, w->lb, w->ub);
+		expect(w->peak.value == hi, "%s: peak %g, not %g", what, w->peak.value, hi);
+		expect(w->low.value == lo, "%s: low %g, not %g", what, w->low.value, lo);
+		expect_near(w->impulse.value, area, 1e-9, what);
+
+		// 2. Through the integrator, the long way round
+		phy_set_bounds(bounds);
+		expect_near(w->impulse.value, metric(1, METRIC_VIMPULSE), 1e-9, what);
+		phy_set_bounds(NULL);
+	}
+
+	bf_close();
+}
+
+// MARK: Events
+
+// Standing at 700 N every ms, then in the air from the 403rd sample
+// until land, and back at 700 N. Force drops to 30 N on 402 and 10 N
+// on 403, so it's through 20 N at 0.4025 s, and comes up from 5 N to
+// 65 N at land, through 50 N three quarters of the way there. A dip
+// to 30 N while standing and a bump to 40 N in the air are inside the
+// hysteresis, and mustn't count.
+static void events_signal(struct column *c, size_t n, size_t land) {
+	column_clear(c);
+	c->run = 1;
+	snprintf(c->field, sizeof(c->field), "Force(N)");
+
+	for (size_t i = 0; i < n; i++) {
+		double v = 700;
+
+		if (i == 200 || i == 402) {
+			v = 30;
+		} else if (i == 403) {
+			v = 10;
+		} else if (i == 600) {
+			v = 40;
+		} else if (i == land - 1) {
+			v = 5;
+		} else if (i == land) {
+			v = 65;
+		} else if (i > 403 && i < land) {
+			v = 0;
+		}
+
+		column_push(c, (double)i * 0.001, v);
+	}
+}
+
+// sig_events scans 8 samples at a time from wherever it last stopped,
+// then finishes off whatever's left one by one. Takeoff at 403 is in
+// the middle of the 51st block from 0. From there, landing at 810 is
+// the last sample of a block, and landing at 806 with only 808 samples
+// is in what's left over. Either way and either layout, the crossings
+// come out to interpolation precision. Then through the metrics, -e
+// style: rawheight is 9.81 * (0.80975 - 0.4025)^2 / 8, and vimpulse
+// stops at takeoff, same as if it had been told 0.4025.
+static void check_events(void) {
+	static struct column c = { 0 };
+	static const size_t cases[][2] = { { 2000, 810 }, { 808, 806 } };
+	struct event up = { 0 }, down = { 0 };
+	struct bf_error e = { 0 };
+	double bounds[2] = { 0, 0.4025 };
+	double air = 0.80975 - 0.4025, bounded = 0;
+	char path[BUFSIZ] = { 0 }, what[64] = { 0 };
+	FILE *fp = NULL;
+
+	for (int packed = 0; packed < 2; packed++) {
+		csv_set_packed(packed);
+
+		for (size_t k = 0; k < sizeof(cases) / sizeof(*cases); k++) {
+			double landed = ((double)cases[k][1] - 0.25) * 0.001;
+
+			snprintf(what, sizeof(what), "landing at %zu of %zu, packed=%d", cases[k][1], cases[k][0], packed);
+			events_signal(&c, cases[k][0], cases[k][1]);
+			if (sig_events(&c, EVENT_OFF_N, EVENT_ON_N, &up, &down) != 0) {
+				expect(0, "%s: no events", what);
+				continue;
+			}
+
+			expect_near(up.timestamp, 0.4025, 1e-9, what);
+			expect_near(up.slope, -20000, 1e-3, what);
+			expect_near(down.timestamp, landed, 1e-9, what);
+			expect_near(down.slope, 60000, 1e-3, what);
+		}
+	}
+
+	csv_set_packed(0);
+
+	// Through the metrics
+	snprintf(path, sizeof(path), "%s/events.csv", scratch);
+	if (NULL == (fp = fopen(path, "w"))) {
+		err(1, "%s", path);
+	}
+
+	events_signal(&c, 2000, 810);
+	fprintf(fp, "Data Set 1:Time(s),Data Set 1:Force(N),Data Set 1:Lateral Force(N),Data Set 1:Hang Time(s),\n");
+	for (size_t i = 0; i < c.n; i++) {
+		fprintf(fp, "%.3f,%g,10,,\n", column_ts(&c, i), column_v(&c, i));
+	}
+
+	if (fclose(fp) != 0) {
+		err(1, "%s", path);
+	}
+
+	if (bf_open(path, &e) != BF_OK) {
+		expect(0, "%s: %s", path, e.msg);
+		return;
+	}
+
+	phy_set_bounds(bounds);
+	bounded = metric(1, METRIC_VIMPULSE);
+	phy_set_bounds(NULL);
+
+	phy_set_events(EVENTS_FORCE);
+	expect_near(metric(1, METRIC_RAWHEIGHT), 9.81 * air * air / 8, 1e-9, "rawheight from force");
+	expect_near(metric(1, METRIC_VIMPULSE), bounded, 1e-9, "vimpulse up to takeoff from force");
+	phy_set_events(EVENTS_HANGTIME);
+	bf_close();
+}
+
+// MARK: Filters
+
+// 2 s at 1 kHz of 700 N, of 700 N with 100 N at 200 Hz on top, or of
+// a step from 0 to 1000 N between the 999th and 1000th ms
+enum { SIGNAL_DC, SIGNAL_TONE, SIGNAL_STEP };
+
+static const struct column *filtered_signal(int signal, const char *spec) {
+	static struct column in = { 0 }, out = { 0 };
+	struct filter f = { 0 };
+
+	column_clear(&in);
+	in.run = 1;
+	snprintf(in.field, sizeof(in.field), "Force(N)");
+
+	for (int i = 0; i < 2000; i++) {
+		double t = i * 0.001;
+
+		switch (signal) {
+			case SIGNAL_DC:
+				column_push(&in, t, 700);
+				break;
+			case SIGNAL_TONE:
+				column_push(&in, t, 700 + 100 * sin(2 * M_PI * 200 * t));
+				break;
+			default:
+				column_push(&in, t, i < 1000 ? 0 : 1000);
+				break;
+		}
+	}
+
+	expect(sig_parse_filter(spec, &f) == 0, "%s doesn't parse", spec);
+	sig_filter(&out, &in, &f);
+	return &out;
+}
+
+// Every kind passes DC untouched, edges and all, and takes a tone ten
+// times the cutoff down to under a percent. Zero phase means a step
+// comes out symmetric about where it went in: y[999 - j] + y[1000 + j]
+// is the whole step, where causal filters are still near 0 at 1000.
+// Then the filtered copy of a column being watched has to follow it
+// as rows get appended.
+static void check_filter(void) {
+	static const char *kinds[] = { "fir:20", "fir:20,zp", "iir:20", "iir:20,zp" };
+	static struct csv_change changes[4] = { 0 };
+	struct desc d = { .run = 1, .field = "Force(N)" };
+	struct filter f = { .kind = FILTER_NONE, .decimate = 1 };
+	struct bf_error e = { 0 };
+	const struct column *c = NULL;
+	const char *path = NULL;
+	FILE *fp = NULL;
+	int partial = 0;
+
+	for (size_t k = 0; k < sizeof(kinds) / sizeof(*kinds); k++) {
+		double dc = 0, tone = 0, step = 0;
+
+		// 1. DC
+		c = filtered_signal(SIGNAL_DC, kinds[k]);
+		for (size_t i = 0; i < c->n; i++) {
+			dc = fmax(dc, fabs(column_v(c, i) - 700));
+		}
+		expect(dc <= 1e-9, "%s: DC off by %g", kinds[k], dc);
+
+		// 2. Away from the edges, a tone above the cutoff
+		c = filtered_signal(SIGNAL_TONE, kinds[k]);
+		for (size_t i = 500; i < 1500; i++) {
+			tone = fmax(tone, fabs(column_v(c, i) - 700));
+		}
+		expect(tone <= 1, "%s: 200 Hz only down to %g N", kinds[k], tone);
+
+		// 3. The step, delayed or not
+		c = filtered_signal(SIGNAL_STEP, kinds[k]);
+		if (strstr(kinds[k], ",zp") == NULL) {
+			expect(column_v(c, 1000) < 100, "%s: %g N right after the step", kinds[k], column_v(c, 1000));
+			continue;
+		}
+
+		for (size_t j = 0; j < 200; j++) {
+			step = fmax(step, fabs(column_v(c, 999 - j) + column_v(c, 1000 + j) - 1000));
+		}
+		expect(step <= 1e-6, "%s: step lopsided by %g N", kinds[k], step);
+	}
+
+	// 4. Appended rows bump the column's serial, and the filtered copy
+	// goes stale with it
+	path = write_long("watched.csv", 2000, 0);
+	if (bf_open(path, &e) != BF_OK) {
+		expect(0, "%s: %s", path, e.msg);
+		return;
+	}
+
+	sig_parse_filter("iir:20,zp", &f);
+	sig_set_filter(&f);
+	expect(csv_watch() == 0, "%s: no rows", path);
+	c = sig_column(d);
+	expect(c->n == 2000, "%zu of 2000 samples filtered", c->n);
+
+	if (NULL == (fp = fopen(path, "a"))) {
+		err(1, "%s", path);
+	}
+	for (int i = 2000; i < 3000; i++) {
+		fprintf(fp, "%.4f,1000.000,10.000,,\n", i * 0.001);
+	}
+	if (fclose(fp) != 0) {
+		err(1, "%s", path);
+	}
+
+	expect(csv_refresh(changes, 4, &partial) == 1 && changes[0].run == 1, "appended rows not seen");
+	c = sig_column(d);
+	expect(c->n == 3000, "%zu of 3000 samples filtered after appending", c->n);
+	expect_near(column_v(c, c->n - 1), 1000, 1e-6, "last appended sample, filtered");
+
+	f = (struct filter){ .kind = FILTER_NONE, .decimate = 1 };
+	sig_set_filter(&f);
+	bf_close();
+}
+
+// MARK: Simpson
+
+// vimpulse over [0.3, 1.9] s of smooth.csv, one rule or the other
+static struct dual smooth_impulse(int rule) {
+	struct desc d = { .run = 1, .field = "Force(N)" };
+
+	return math_intdt(d, dual_const(0.3), dual_const(1.9), NULL, rule);
+}
+
+// One integral and its quadrature estimate against what it should be.
+// Simpson is off by at most (b - a) h^4 / 180 max|f''''|, which is
+// 1.6 / 180 * 300 * 3^4 h^4 = 216 h^4, and trapezoids by (b - a) h^2
+// / 12 max|f''| = 360 h^2. The estimate should be within a factor of
+// two of Simpson's actual error either way; the slack is for where
+// both are down in the roundoff.
+static void expect_simpson(double h, double want, const char *what) {
+	struct dual s = smooth_impulse(QUAD_SIMPSON);
+	struct dual t = smooth_impulse(QUAD_TRAPEZOID);
+	double off = fabs(s.value - want), ucty = fabs(s.d[UCTY_QUADRATURE]);
+
+	expect(off <= 216 * pow(h, 4) + 1e-9, "%s: Simpson off by %g", what, off);
+	expect(fabs(t.value - want) <= 360 * h * h, "%s: trapezoids off by %g", what, fabs(t.value - want));
+	expect(off <= 2 * ucty + 1e-9 && ucty <= 2 * off + 1e-9,
+	    "%s: Simpson off by %g, says %g", what, off, ucty);
+}
+
+// smooth.csv is 700 + 300 sin(3t + 0.4) N every ms for 2.2 s, then
+// the same low-passed at 20 Hz and decimated down to 50 Hz. Simpson
+// should hold its fourth order all the way, which groups of four that
+// weren't trusted through an inflection would knock back to
+// trapezoids'. The filter moves the integral by some 2e-5 N s itself,
+// so decimated runs are up against the full rate filtered one:
+// decimating only picks samples of that, and a 20 Hz low-pass takes
+// next to nothing off a 0.5 Hz signal's derivatives.
+static void check_simpson(void) {
+	static const int decimate[] = { 4, 10, 20 };
+	struct bf_error e = { 0 };
+	struct filter f = { .kind = FILTER_NONE, .decimate = 1 };
+	double want = 700 * 1.6 + 100 * (cos(3 * 0.3 + 0.4) - cos(3 * 1.9 + 0.4));
+	char path[BUFSIZ] = { 0 }, spec[32] = { 0 }, what[32] = { 0 };
+	FILE *fp = NULL;
+
+	snprintf(path, sizeof(path), "%s/smooth.csv", scratch);
+	if (NULL == (fp = fopen(path, "w"))) {
+		err(1, "%s", path);
+	}
+
+	fprintf(fp, "Data Set 1:Time(s),Data Set 1:Force(N),Data Set 1:Lateral Force(N),Data Set 1:Hang Time(s),\n");
+	for (int i = 0; i <= 2200; i++) {
+		fprintf(fp, "%.3f,%.9f,10,,\n", i * 0.001, 700 + 300 * sin(3 * i * 0.001 + 0.4));
+	}
+
+	if (fclose(fp) != 0) {
+		err(1, "%s", path);
+	}
+
+	if (bf_open(path, &e) != BF_OK) {
+		expect(0, "%s: %s", path, e.msg);
+		return;
+	}
+
+	// 1. Full rate, against the real thing
+	expect_simpson(0.001, want, "1 kHz");
+
+	// 2. Decimated, against full rate through the same filter
+	sig_parse_filter("iir:20,zp", &f);
+	sig_set_filter(&f);
+	want = smooth_impulse(QUAD_SIMPSON).value;
+
+	for (size_t i = 0; i < sizeof(decimate) / sizeof(*decimate); i++) {
+		snprintf(spec, sizeof(spec), "iir:20,zp,dec=%d", decimate[i]);
+		snprintf(what, sizeof(what), "%d Hz", 1000 / decimate[i]);
+		sig_parse_filter(spec, &f);
+		sig_set_filter(&f);
+		expect_simpson(0.001 * decimate[i], want, what);
+	}
+
+	f = (struct filter){ .kind = FILTER_NONE, .decimate = 1 };
+	sig_set_filter(&f);
+	bf_close();
+}
+
+int main(int argc, char *argv[]) {
+	if (argc != 3) {
+		fprintf(stderr, "usage: check fixtures scratch\n");
+		return 1;
+	}
+
+	fixtures = argv[1];
+	scratch = argv[2];
+
+	check_recovery();
+	check_lag();
+	check_cache();
+	check_packed();
+	check_dialects();
+	check_roll();
+	check_events();
+	check_filter();
+	check_simpson();
+
+	return failures;
+}
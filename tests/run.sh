@@ -0,0 +1,120 @@
+#!/bin/sh
+#
+# Builds tests/check.c against the core and runs it, then puts the
+# command line through its paces on the same fixtures.
+#
+#	sh tests/run.sh [backflip]
+#
+# Without a backflip to test, one gets built from the tree.
+
+set -u
+
+tests=$(cd "$(dirname "$0")" && pwd)
+top=$(dirname "$tests")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2 -Wall -Wextra -Werror}
+failures=0
+
+fail() {
+	echo "run.sh: $*" >&2
+	failures=$((failures + 1))
+}
+
+# MARK: Building
+
+if [ $# -gt 0 ]; then
+	backflip=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+fi
+
+cd "$top" || exit 1
+
+$CC $CFLAGS -I"$top" -o "$scratch/check" "$tests/check.c" \
+    lib.c csv.c math.c sig.c phy.c cache.c -lm || exit 1
+
+if [ $# -eq 0 ]; then
+	backflip="$scratch/backflip"
+	$CC $CFLAGS -o "$backflip" main.c phy.c math.c csv.c sig.c srv.c \
+	    watch.c cat.c lib.c out.c cache.c -lm || exit 1
+fi
+
+# MARK: The core
+
+mkdir "$scratch/work"
+"$scratch/check" "$tests" "$scratch/work" || fail "check: $? failed"
+
+# MARK: Command line
+
+# A catalog keeps going past runs it can't analyze, and says so
+printf 'ada ramp.csv j1 j2 j3 j4\n' > "$scratch/catalog"
+cp "$tests/ramp.csv" "$scratch/"
+out=$("$backflip" -C "$scratch/catalog" 2>"$scratch/err")
+echo "$out" | grep -q '^ATHLETE ada: 1 captures, 1 runs, 3 runs skipped$' ||
+    fail "catalog: $out"
+[ "$(grep -c 'skipping' "$scratch/err")" -eq 3 ] ||
+    fail "catalog: $(cat "$scratch/err")"
+
+# Workers' partials are bigger than a pipe's atomic write, and a pool's
+# worth of them coming back at once should add up the same as one at a
+# time
+: > "$scratch/catalog"
+for i in 1 2 3 4 5 6 7 8; do
+	printf 'bo ramp.csv j1\n' >> "$scratch/catalog"
+done
+one=$("$backflip" -C "$scratch/catalog" -P 1)
+out=$("$backflip" -C "$scratch/catalog" -P 8)
+echo "$out" | grep -q '^ATHLETE bo: 8 captures, 8 runs$' || fail "catalog: $out"
+echo "$out" | grep -q 'JUMP Vertical Impulse  *325.000000 .* n=8 ' ||
+    fail "catalog: $out"
+[ "$out" = "$one" ] || fail "catalog, 8 at once: $out"
+
+# The daemon notices a capture rewritten at the same size, even within
+# the same second
+"$backflip" -S "$scratch/sock" 2>"$scratch/err" &
+daemon=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+	[ -S "$scratch/sock" ] && break
+	sleep 1
+done
+cp "$tests/ramp.csv" "$scratch/rewritten.csv"
+before=$("$backflip" -Q "$scratch/sock" -c "$scratch/rewritten.csv" -j 1 -o jsonl)
+sed 's/^0\.05,650,/0.05,950,/' "$tests/ramp.csv" > "$scratch/rewritten.csv"
+after=$("$backflip" -Q "$scratch/sock" -c "$scratch/rewritten.csv" -j 1 -o jsonl)
+kill $daemon
+echo "$before" | grep -q '"vimpulse","value":325,' || fail "daemon: $before"
+echo "$after" | grep -q '"vimpulse","value":328,' || fail "daemon, rewritten: $after"
+
+# -d gets the same answers out of the other dialects
+plain=$("$backflip" -c "$tests/ramp.csv" -j 1 -o jsonl)
+for dialect in "semicolon.csv ;" "tab.csv tab" "quoted.csv ,"; do
+	set -- $dialect
+	out=$("$backflip" -c "$tests/$1" -d "$2" -j 1 -o jsonl)
+	[ "$out" = "$plain" ] || fail "$1: $out"
+done
+
+# -W's row at +0 is the plain answer, to the bit, and its row at +k ms
+# integrates as far as -b would up to takeoff + k ms, whether that's
+# on a sample or between two
+out=$("$backflip" -c "$tests/ramp.csv" -j 1 -o jsonl -W 30,5)
+zero=$(echo "$out" | grep '"offset":0,' | sed 's/"offset":0,"ub":[^,]*,//')
+[ "$zero" = "$plain" ] || fail "sweep, +0: $zero"
+row=0
+for k in -30 -25 -20 -15 -10 -5 0 5 10 15 20 25 30; do
+	row=$((row + 1))
+	ub=$(awk "BEGIN { printf \"%.3f\", 0.41 + $k / 1000 }")
+	swept=$(echo "$out" | grep '"vimpulse"' | sed -n "${row}p" |
+	    sed 's/.*"value":\([^,]*\),.*/\1/')
+	bounded=$("$backflip" -c "$tests/ramp.csv" -j 1 -o jsonl -b "0,$ub" |
+	    grep '"vimpulse"' | sed 's/.*"value":\([^,]*\),.*/\1/')
+	[ -n "$swept" ] && [ "$swept" = "$bounded" ] ||
+	    fail "sweep, $k ms: $swept, not $bounded"
+done
+
+if [ $failures -gt 0 ]; then
+	echo "$failures failed" >&2
+	exit 1
+fi
+
+echo "all good"
@@ -0,0 +1,86 @@
+#include <sys/types.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#else
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "physics.h"
+
+// Blocking on a file until it gets written to. kqueue(2) on the BSDs
+// and macOS, inotify(7) on Linux; either way, one descriptor to wait on.
+
+#ifdef __linux__
+
+int watch_open(const char *path) {
+	int fd = -1;
+
+	assert(path != NULL);
+
+	if ((fd = inotify_init()) < 0) {
+		err(1, "inotify_init");
+	} else if (inotify_add_watch(fd, path, IN_MODIFY) < 0) {
+		err(1, "inotify_add_watch %s", path);
+	}
+
+	return fd;
+}
+
+void watch_wait(int wfd) {
+	char buf[sizeof(struct inotify_event) + NAME_MAX + 1] = { 0 };
+
+	for (;;) {
+		ssize_t r = read(wfd, buf, sizeof(buf));
+
+		if (r > 0) {
+			return;
+		} else if (r < 0 && errno != EINTR) {
+			err(1, "inotify read");
+		}
+	}
+}
+
+#else
+
+int watch_open(const char *path) {
+	struct kevent ev = { 0 };
+	int kq = -1, fd = -1;
+
+	assert(path != NULL);
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		err(1, "open %s", path);
+	} else if ((kq = kqueue()) < 0) {
+		err(1, "kqueue");
+	}
+
+	EV_SET(&ev, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND, 0, NULL);
+	if (kevent(kq, &ev, 1, NULL, 0, NULL) < 0) {
+		err(1, "kevent %s", path);
+	}
+
+	return kq;
+}
+
+void watch_wait(int wfd) {
+	struct kevent ev = { 0 };
+
+	for (;;) {
+		int r = kevent(wfd, NULL, 0, &ev, 1, NULL);
+
+		if (r > 0) {
+			return;
+		} else if (r < 0 && errno != EINTR) {
+			err(1, "kevent");
+		}
+	}
+}
+
+#endif // __linux__